@@ -25,10 +25,15 @@ namespace clang {
 }
 
 clang::FileID CreateFileIDForMemBuffer(clang::Preprocessor &PP, llvm::MemoryBuffer *Buf, clang::SourceLocation Loc)
+{
+    return CreateFileIDForMemBuffer(PP.getSourceManager(), Buf, Loc);
+}
+
+clang::FileID CreateFileIDForMemBuffer(clang::SourceManager &SM, llvm::MemoryBuffer *Buf, clang::SourceLocation Loc)
 {
 #if CLANG_VERSION_MAJOR != 3 || CLANG_VERSION_MINOR > 4
-    return PP.getSourceManager().createFileID(maybe_unique(Buf), clang::SrcMgr::C_User, 0, 0, Loc);
+    return SM.createFileID(maybe_unique(Buf), clang::SrcMgr::C_User, 0, 0, Loc);
 #else
-    return PP.getSourceManager().createFileIDForMemBuffer(Buf, clang::SrcMgr::C_User, 0, 0, Loc);
+    return SM.createFileIDForMemBuffer(Buf, clang::SrcMgr::C_User, 0, 0, Loc);
 #endif
 }
\ No newline at end of file
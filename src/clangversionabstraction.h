@@ -25,6 +25,7 @@
 
 namespace clang {
     class Preprocessor;
+    class SourceManager;
 }
 namespace llvm {
     class MemoryBuffer;
@@ -33,6 +34,7 @@ namespace llvm {
 // Abstract the API changes in clang
 
 clang::FileID CreateFileIDForMemBuffer(clang::Preprocessor &PP, llvm::MemoryBuffer *Buf, clang::SourceLocation Loc);
+clang::FileID CreateFileIDForMemBuffer(clang::SourceManager &SM, llvm::MemoryBuffer *Buf, clang::SourceLocation Loc);
 
 // clang 3.6 uses unique_ptr in many places that was not using it before
 template<typename T> struct MaybeUnique {
@@ -21,10 +21,14 @@
 #include "mocng.h"
 #include "qbjs.h"
 #include <string>
+#include <algorithm>
+#include <map>
 #include <clang/AST/DeclCXX.h>
 #include <clang/AST/ASTContext.h>
 #include <clang/AST/DeclTemplate.h>
+#include <clang/Basic/TargetInfo.h>
 #include <clang/Sema/Sema.h>
+#include <llvm/ADT/StringSwitch.h>
 
 #include <iostream>
 
@@ -143,7 +147,10 @@ void Generator::GenerateFunctions(const std::vector<T> &V, const char* TypeName,
         if (HasPrivateSignal(M))
             argc--;
 
-        std::string tag = Moc->GetTag(M->getSourceRange().getBegin(), Ctx.getSourceManager());
+        auto TagIt = CDef->MethodTags.find(M);
+        llvm::StringRef tag;
+        if (TagIt != CDef->MethodTags.end())
+            tag = TagIt->second;
         OS << "    " << StrIdx(M->getNameAsString()) << ", " << argc << ", " << ParamIndex << ", " << StrIdx(tag) << ", 0x";
         OS.write_hex(Flags) << ",\n";
         ParamIndex += 1 + argc * 2;
@@ -155,6 +162,121 @@ static bool IsIdentChar(char c) {
     return (c=='_' || c=='$' || (c >= '0' && c <= '9') || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z'));
 }
 
+/* The builtin meta types of QtCore, by normalized name, with their value in QMetaType::Type.
+ * Only the types which exist since Qt 5.0. The other types are resolved at runtime by name.
+ */
+static const char *BuiltinMetaType(llvm::StringRef Name)
+{
+    return llvm::StringSwitch<const char *>(Name)
+        .Case("void", "Void")
+        .Case("bool", "Bool")
+        .Case("int", "Int")
+        .Case("uint", "UInt")
+        .Case("qlonglong", "LongLong")
+        .Case("qulonglong", "ULongLong")
+        .Case("double", "Double")
+        .Case("long", "Long")
+        .Case("short", "Short")
+        .Case("char", "Char")
+        .Case("ulong", "ULong")
+        .Case("ushort", "UShort")
+        .Case("uchar", "UChar")
+        .Case("float", "Float")
+        .Case("signed char", "SChar")
+        .Case("void*", "VoidStar")
+        .Case("QObject*", "QObjectStar")
+        .Case("qreal", "QReal")
+        // aliases registered by QMetaType
+        .Case("long long", "LongLong")
+        .Case("qint8", "SChar")
+        .Case("quint8", "UChar")
+        .Case("qint16", "Short")
+        .Case("quint16", "UShort")
+        .Case("qint32", "Int")
+        .Case("quint32", "UInt")
+        .Case("qint64", "LongLong")
+        .Case("quint64", "ULongLong")
+        .Case("QList<QVariant>", "QVariantList")
+        .Case("QMap<QString,QVariant>", "QVariantMap")
+        .Case("QHash<QString,QVariant>", "QVariantHash")
+        // classes
+        .Case("QChar", "QChar")
+        .Case("QString", "QString")
+        .Case("QStringList", "QStringList")
+        .Case("QByteArray", "QByteArray")
+        .Case("QBitArray", "QBitArray")
+        .Case("QDate", "QDate")
+        .Case("QTime", "QTime")
+        .Case("QDateTime", "QDateTime")
+        .Case("QUrl", "QUrl")
+        .Case("QLocale", "QLocale")
+        .Case("QRect", "QRect")
+        .Case("QRectF", "QRectF")
+        .Case("QSize", "QSize")
+        .Case("QSizeF", "QSizeF")
+        .Case("QLine", "QLine")
+        .Case("QLineF", "QLineF")
+        .Case("QPoint", "QPoint")
+        .Case("QPointF", "QPointF")
+        .Case("QRegExp", "QRegExp")
+        .Case("QEasingCurve", "QEasingCurve")
+        .Case("QUuid", "QUuid")
+        .Case("QVariant", "QVariant")
+        .Case("QModelIndex", "QModelIndex")
+        .Case("QRegularExpression", "QRegularExpression")
+        .Case("QJsonValue", "QJsonValue")
+        .Case("QJsonObject", "QJsonObject")
+        .Case("QJsonArray", "QJsonArray")
+        .Case("QJsonDocument", "QJsonDocument")
+        .Case("QVariantMap", "QVariantMap")
+        .Case("QVariantList", "QVariantList")
+        .Case("QVariantHash", "QVariantHash")
+        .Default(nullptr);
+}
+
+// The builtin types are only looked up by name: check that it is really the Qt type, and not
+// a type with the same name within another namespace.
+static bool IsDeclaredAtTopLevel(clang::QualType T)
+{
+    const clang::Decl *D = nullptr;
+    if (auto TT = T->getAs<clang::TypedefType>())
+        D = TT->getDecl();
+    else if (T->isPointerType())
+        D = T->getPointeeCXXRecordDecl();
+    else
+        D = T->getAsCXXRecordDecl();
+    return !D || D->getDeclContext()->getRedeclContext()->isTranslationUnit();
+}
+
+// Same as BuiltinMetaType, for the types that only have a name. As with IsDeclaredAtTopLevel, the
+// name must not be the one of a type declared in the class or in one of its enclosing namespaces.
+const char *Generator::BuiltinMetaTypeForName(llvm::StringRef TypeName)
+{
+    const char *Builtin = BuiltinMetaType(TypeName);
+    if (!Builtin || !CDef)
+        return Builtin;
+    size_t Len = 0;
+    while (Len < TypeName.size() && IsIdentChar(TypeName[Len]))
+        ++Len;
+    clang::IdentifierInfo &II = Ctx.Idents.get(TypeName.substr(0, Len));
+    for (clang::DeclContext *DC = CDef->Record; DC && !DC->isTranslationUnit(); DC = DC->getParent()) {
+        for (auto *D : DC->lookup(&II)) {
+            if (llvm::isa<clang::TypeDecl>(D))
+                return nullptr;
+        }
+    }
+    return Builtin;
+}
+
+// For the types that only have a name (private slots and properties)
+void Generator::GenerateTypeInfo(llvm::StringRef TypeName)
+{
+    if (const char *Builtin = BuiltinMetaTypeForName(TypeName))
+        OS << "QMetaType::" << Builtin;
+    else
+        OS << "0x80000000 | " << StrIdx(TypeName);
+}
+
 //Generate the type information for the argument
 void Generator::GenerateTypeInfo(clang::QualType Type)
 {
@@ -169,8 +291,8 @@ void Generator::GenerateTypeInfo(clang::QualType Type)
     Type.removeLocalConst();
 
     const clang::TypedefType * TT = Type->getAs<clang::TypedefType>();
-    // Handle builtin types as QMetaType,  but ignores typedef their name is likely not registered
-    //  (FIXME:  all the registered typedef such as uint and qint64 should go there.
+    // Handle builtin types as QMetaType, but not through a typedef: the registered ones (uint,
+    // qint64, ...) are found by name with BuiltinMetaType below.
     if (Type->isBuiltinType() && (!TT)) {
         const clang::BuiltinType * BT = Type->getAs<clang::BuiltinType>();
         switch(+BT->getKind()) {
@@ -195,43 +317,51 @@ void Generator::GenerateTypeInfo(clang::QualType Type)
 #undef BUILTIN
         }
     }
-    // TODO:  Find more QMetaType
-
-
-    clang::PrintingPolicy Policy = PrintPolicy;
-    Policy.SuppressScope = true;
-    std::string TypeString = getDesugarType(Type).getAsString(Policy);
 
-    // Remove the spaces;
-    int k = 0;
-    for (uint i = 0; i < TypeString.size(); ++i) {
-        char C = TypeString[i];
-        if (C == ' ') {
-            if (k == 0)
-                continue;
-            if (i+1 == TypeString.size())
-                continue;
-            char P = TypeString[k-1];
-            char N = TypeString[i+1];
-            if (!(IsIdentChar(P) && IsIdentChar(N))
-                && !(P == '>' && N == '>'))
-                continue;
+    // The same types are used again and again by the different methods and classes
+    std::string &TypeString = Moc->TypeNames[Type.getAsOpaquePtr()];
+    if (TypeString.empty()) {
+        clang::PrintingPolicy Policy = PrintPolicy;
+        Policy.SuppressScope = true;
+        TypeString = getDesugarType(Type).getAsString(Policy);
+
+        // Remove the spaces;
+        int k = 0;
+        for (uint i = 0; i < TypeString.size(); ++i) {
+            char C = TypeString[i];
+            if (C == ' ') {
+                if (k == 0)
+                    continue;
+                if (i+1 == TypeString.size())
+                    continue;
+                char P = TypeString[k-1];
+                char N = TypeString[i+1];
+                if (!(IsIdentChar(P) && IsIdentChar(N))
+                    && !(P == '>' && N == '>'))
+                    continue;
+            }
+            TypeString[k++] = C;
         }
-        TypeString[k++] = C;
-    }
-    TypeString.resize(k);
-
-    //adjust unsigned
-    uint UPos = 0;
-    while ((UPos = TypeString.find("unsigned ", UPos)) < TypeString.size()) {
-        const int L = sizeof("unsigned ") - 1; // don't include \0
-        llvm::StringRef R(&TypeString[UPos + L],
-                          TypeString.size() - L);
-        if (R.startswith("int") || (R.startswith("long") &&
-            !R.startswith("long int") && !R.startswith("long long"))) {
-            TypeString.replace(UPos, L, "u");
+        TypeString.resize(k);
+
+        //adjust unsigned
+        uint UPos = 0;
+        while ((UPos = TypeString.find("unsigned ", UPos)) < TypeString.size()) {
+            const int L = sizeof("unsigned ") - 1; // don't include \0
+            llvm::StringRef R(&TypeString[UPos + L],
+                              TypeString.size() - L);
+            if (R.startswith("int") || (R.startswith("long") &&
+                !R.startswith("long int") && !R.startswith("long long"))) {
+                TypeString.replace(UPos, L, "u");
+            }
+            UPos++;
+        }
+    }
+    if (IsDeclaredAtTopLevel(Type)) {
+        if (const char *Builtin = BuiltinMetaType(TypeString)) {
+            OS << "QMetaType::" << Builtin;
+            return;
         }
-        UPos++;
     }
     OS << "0x80000000 | " << StrIdx(TypeString);
 }
@@ -420,6 +550,10 @@ Generator::Generator(const NamespaceDef* NDef, llvm::raw_ostream& OS, clang::AST
 
 void Generator::GenerateCode()
 {
+    // The data of the template header can't refer to the shared strings, which are static.
+    if (HasTemplateHeader || IsQtNamespace)
+        SharedStrings = nullptr;
+
     // Build the data array
     std::string QualifiedClassNameIdentifier = QualName;
     if (CDef && CDef->Record->getDescribedClassTemplate()) {
@@ -445,7 +579,9 @@ void Generator::GenerateCode()
         OS_TemplateHeader << "\nextern const uint qt_meta_data_" << QualifiedClassNameIdentifier << "[];\n";
     }
 
-    OS << "\n" << Static << "const uint qt_meta_data_" << QualifiedClassNameIdentifier << "[] = {\n"
+    // With --constexpr-data, make sure the data is initialized at compile time.
+    llvm::StringRef Constexpr = ConstexprData && !HasTemplateHeader ? "Q_DECL_CONSTEXPR " : "";
+    OS << "\n" << Static << Constexpr << "const uint qt_meta_data_" << QualifiedClassNameIdentifier << "[] = {\n"
           "    " << OutputRevision << ", // revision\n"
           "    " << StrIdx(QualName) << ", // classname\n"
           "    " << Def->ClassInfo.size() << ", " << I(Def->ClassInfo.size() * 2) << ", //classinfo\n";
@@ -549,12 +685,10 @@ void Generator::GenerateCode()
             for (int Clone = 0; Clone <= P.NumDefault; ++Clone) {
                 int argc = (P.Args.size() - Clone);
                 OS << "    ";
-                if (P.ReturnType == "void") OS << "QMetaType::Void";
-                else OS << "0x80000000 | " << StrIdx(P.ReturnType);
+                GenerateTypeInfo(P.ReturnType);
                 for (int j = 0; j < argc; j++) {
                     OS << ", ";
-                    if (P.Args[j] == "void") OS << "QMetaType::Void";
-                    else OS << "0x80000000 | " << StrIdx(P.Args[j]);
+                    GenerateTypeInfo(P.Args[j]);
                 }
                 //Names
                 for (int j = 0; j < argc; j++) {
@@ -576,40 +710,191 @@ void Generator::GenerateCode()
     }
 
     OS << "\n    0    // eod\n};\n";
+    Stats.ClassName = QualName;
+    Stats.DataBytes = (Index + 1) * sizeof(uint32_t);
+    if (ConstexprData) {
+        // Let the compiler check the offsets computed in the header of the data.
+        OS << "Q_STATIC_ASSERT_X(sizeof(qt_meta_data_" << QualifiedClassNameIdentifier << ") == "
+           << (Index + 1) << " * sizeof(uint), \"moc-ng: inconsistent meta data\");\n";
+    }
 
     // StringArray;
+    std::string StringData = "qt_meta_stringdata_" + QualifiedClassNameIdentifier;
+    // The name of the class, for qt_metacast
+    std::string ClassNameData = StringData + (ConstexprData ? ".stringdata0" : ".stringdata");
+    if (SharedStrings) {
+        StringData = SharedStringsName;
+        int ClassNameIdx = StrIdx(QualName);
+        if (ConstexprData)
+            ClassNameData = StringData + ".stringdata" + std::to_string(ClassNameIdx);
+        else
+            ClassNameData = "(" + StringData + ".stringdata + " + std::to_string(SharedStrings->Offset(ClassNameIdx)) + ")";
+    } else {
+        GenerateStringData(OS, OS_TemplateHeader, OwnStrings, StringData, HasTemplateHeader, ConstexprData);
+    }
+
+    // The strings of this class, even if they are in the shared string data.
+    // sizeof(QByteArrayData) is 3 ints and a pointer.
+    unsigned PointerBytes = Ctx.getTargetInfo().getPointerWidth(0) / 8;
+    unsigned ByteArrayDataBytes = (12 + PointerBytes - 1) / PointerBytes * PointerBytes + PointerBytes;
+    Stats.StringCount = OwnStrings.Strings.size();
+    Stats.StringBytes = OwnStrings.Strings.size() * ByteArrayDataBytes;
+    for (const auto &S : OwnStrings.Strings)
+        Stats.StringBytes += S.size() + 1;
+
+    if (!Def->Extra.empty() && SharedExtraData.empty()) {
+        if (HasTemplateHeader)
+            OS_TemplateHeader << "extern const QMetaObject * const qt_meta_extradata_" << QualifiedClassNameIdentifier << "[];\n";
+        OS << Static << "const QMetaObject * const qt_meta_extradata_" << QualifiedClassNameIdentifier << "[] = {\n" ;
+        for (clang::CXXRecordDecl *E : Def->Extra)
+            //TODO: Check that extra is a QObject
+            OS << "    &" << E->getQualifiedNameAsString() << "::staticMetaObject,\n";
+
+        OS << "    0\n};\n";
+
+    }
+
+    if (IsQtNamespace) {
+        OS_TemplateHeader << "\nconst QMetaObject QObject::staticQtMetaObject = {\n"
+              "    { 0, qt_meta_stringdata_Qt.data, qt_meta_data_Qt, 0, 0, 0 }\n};\n";
+        return;
+    }
+
+    OS_TemplateHeader << "\n" << TemplatePrefix << "const QMetaObject " << QualName << "::staticMetaObject = {\n"
+          "    { ";
+    if (BaseName.empty() || (CDef->HasQGadget && !BaseHasStaticMetaObject)) OS_TemplateHeader << "0";
+    else OS_TemplateHeader << "&" << BaseName << "::staticMetaObject";
+
+    OS_TemplateHeader << ", " << StringData << ".data,\n"
+          "      qt_meta_data_" << QualifiedClassNameIdentifier << ", ";
+
+    bool HasStaticMetaCall = CDef && (CDef->HasQObject || !CDef->Methods.empty() || !CDef->Properties.empty() || !CDef->Constructors.empty());
+    if (HasStaticMetaCall) OS_TemplateHeader << "qt_static_metacall, ";
+    else OS_TemplateHeader << "0, ";
+
+    if (!SharedExtraData.empty()) OS_TemplateHeader << SharedExtraData << ", ";
+    else if (!Def->Extra.empty()) OS_TemplateHeader << "qt_meta_extradata_" << QualifiedClassNameIdentifier << ", ";
+    else OS_TemplateHeader << "0, ";
+    OS_TemplateHeader << "0}\n};\n";
+
+    if (CDef && CDef->HasQObject) {
+        OS_TemplateHeader << TemplatePrefix << "const QMetaObject *" << QualName << "::metaObject() const\n{\n"
+              "    return QObject::d_ptr->metaObject ? QObject::d_ptr->dynamicMetaObject() : &staticMetaObject;\n}\n";
+
+
+        if (HashedMetaCast) {
+            GenerateHashedMetaCast(ClassNameData);
+        } else {
+            OS_TemplateHeader <<  TemplatePrefix << "void *" << QualName << "::qt_metacast(const char *_clname)\n{\n"
+                  "    if (!_clname) return 0;\n"
+                  "    if (!strcmp(_clname, " << ClassNameData << "))\n"
+                  "        return static_cast<void*>(this);\n";
+
+            if (CDef->Record->getNumBases() > 1) {
+                for (auto BaseIt = CDef->Record->bases_begin()+1; BaseIt != CDef->Record->bases_end(); ++BaseIt) {
+                    if (BaseIt->getAccessSpecifier() == clang::AS_private)
+                        continue;
+                    auto B = BaseIt->getType().getAsString(PrintPolicy);
+                    OS_TemplateHeader << "    if (!qstrcmp(_clname, \"" << B << "\"))\n"
+                          "        return static_cast< " << B << "*>(this);\n";
+                }
+            }
+
+            for (const auto &Itrf : CDef->Interfaces) {
+                OS_TemplateHeader << "    if (!qstrcmp(_clname, qobject_interface_iid< " << Itrf << " *>()))\n"
+                      "        return static_cast< " << Itrf << "  *>(this);\n";
+            }
+
+            if (BaseName.empty()) OS_TemplateHeader << "    return 0;\n}\n";
+            else OS_TemplateHeader << "    return "<< BaseName <<"::qt_metacast(_clname);\n"
+                       "}\n";
+        }
+
+        GenerateMetaCall();
+        GenerateStaticMetaCall();
+
+        int SigIdx = 0;
+        for (const clang::CXXMethodDecl *MD : CDef->Signals) {
+            GenerateSignal(MD, SigIdx);
+            SigIdx += 1 + MD->getNumParams() - MD->getMinRequiredArguments();
+        }
+    } else if (HasStaticMetaCall) {
+        GenerateStaticMetaCall();
+    }
 
+    if (CDef && !CDef->Plugin.IID.empty()) {
+        OS << "\nQT_PLUGIN_METADATA_SECTION const uint qt_section_alignment_dummy = 42;\n"
+              "#ifdef QT_NO_DEBUG\n";
+        GeneratePluginMetaData(false);
+        OS << "#else\n";
+        GeneratePluginMetaData(true);
+        OS << "#endif\n";
+
+        OS << "QT_MOC_EXPORT_PLUGIN(" << QualName << ", " << CDef->Record->getName() << ")\n\n";
+    }
+}
+
+/* Emits the string data: one QByteArrayData per string, pointing in the char array which follows.
+ * Name is the name of the variable; its type is Name_t.
+ * With StringMembers (--constexpr-data), each string is in its own char array member, so that the
+ * compiler computes the offsets and the lengths.
+ */
+void Generator::GenerateStringData(llvm::raw_ostream &OS, llvm::raw_ostream &OS_TemplateHeader,
+                                   const MetaStringTable &Table, llvm::StringRef Name,
+                                   bool HasTemplateHeader, bool StringMembers)
+{
+    llvm::StringRef Static = HasTemplateHeader ? "" : "static ";
     int TotalLen = 1;
-    for (const auto &S : Strings)
+    for (const auto &S : Table.Strings)
         TotalLen += S.size() + 1;
 
-    OS_TemplateHeader << "struct qt_meta_stringdata_" << QualifiedClassNameIdentifier << "_t {\n"
-          "    QByteArrayData data[" << Strings.size() << "];\n"
-          "    char stringdata[" << TotalLen << "];\n"
-          "};\n";
+    OS_TemplateHeader << "struct " << Name << "_t {\n"
+          "    QByteArrayData data[" << Table.Strings.size() << "];\n";
+    if (StringMembers) {
+        for (uint I = 0; I < Table.Strings.size(); ++I)
+            OS_TemplateHeader << "    char stringdata" << I << "[" << (Table.Strings[I].size() + 1) << "];\n";
+    } else {
+        OS_TemplateHeader << "    char stringdata[" << TotalLen << "];\n";
+    }
+    OS_TemplateHeader << "};\n";
     if (HasTemplateHeader) {
-        OS_TemplateHeader << "extern const qt_meta_stringdata_" << QualifiedClassNameIdentifier
-            << "_t qt_meta_stringdata_"<<  QualifiedClassNameIdentifier << ";\n";
-    }
-    OS << "#define QT_MOC_LITERAL(idx, ofs, len) \\\n"
-          "    Q_STATIC_BYTE_ARRAY_DATA_HEADER_INITIALIZER_WITH_OFFSET(len, \\\n"
-          "    qptrdiff(offsetof(qt_meta_stringdata_"<<  QualifiedClassNameIdentifier << "_t, stringdata) + ofs \\\n"
-          "        - idx * sizeof(QByteArrayData)) \\\n"
-          "    )\n"
-       << Static << "const qt_meta_stringdata_"<<  QualifiedClassNameIdentifier << "_t qt_meta_stringdata_"<<  QualifiedClassNameIdentifier << " = {\n"
+        OS_TemplateHeader << "extern const " << Name << "_t " << Name << ";\n";
+    }
+    if (StringMembers) {
+        OS << "#define QT_MOC_LITERAL(idx, member) \\\n"
+              "    Q_STATIC_BYTE_ARRAY_DATA_HEADER_INITIALIZER_WITH_OFFSET(sizeof(" << Name << "_t::member) - 1, \\\n"
+              "    qptrdiff(offsetof(" << Name << "_t, member) \\\n"
+              "        - idx * sizeof(QByteArrayData)) \\\n"
+              "    )\n";
+    } else {
+        OS << "#define QT_MOC_LITERAL(idx, ofs, len) \\\n"
+              "    Q_STATIC_BYTE_ARRAY_DATA_HEADER_INITIALIZER_WITH_OFFSET(len, \\\n"
+              "    qptrdiff(offsetof(" << Name << "_t, stringdata) + ofs \\\n"
+              "        - idx * sizeof(QByteArrayData)) \\\n"
+              "    )\n";
+    }
+    OS << Static << "const " << Name << "_t " << Name << " = {\n"
           "    {\n";
     int Idx = 0;
     int LitteralIndex = 0;
-    for (const auto &S : Strings) {
+    for (const auto &S : Table.Strings) {
         if (LitteralIndex)
             OS << ",\n";
-        OS << "QT_MOC_LITERAL("<< (LitteralIndex++) << ", " << Idx << ", " << S.size() << ")";
+        if (StringMembers)
+            OS << "QT_MOC_LITERAL(" << LitteralIndex << ", stringdata" << LitteralIndex << ")";
+        else
+            OS << "QT_MOC_LITERAL("<< LitteralIndex << ", " << Idx << ", " << S.size() << ")";
+        LitteralIndex++;
         Idx += S.size() + 1;
     }
     OS << "\n    },\n    \"";
     int Col = 0;
-    for (const auto &S : Strings) {
-        if (Col && Col + S.size() >= 72) {
+    for (const auto &S : Table.Strings) {
+        if (StringMembers && &S != &Table.Strings.front()) {
+            // One literal per member
+            OS << "\",\n    \"";
+            Col = 0;
+        } else if (Col && Col + S.size() >= 72) {
             OS << "\"\n    \"";
             Col = 0;
         } else if (S.size() && ((S[0] >= '0' && S[0] <= '9') || S[0] == '?')) {
@@ -643,97 +928,273 @@ void Generator::GenerateCode()
             }
         }
 
-        OS << "\\0";
+        if (!StringMembers)
+            OS << "\\0";
         Col += 2 + S.size();
     }
     OS << "\"\n};\n"
           "#undef QT_MOC_LITERAL\n";
+}
 
-    if (!Def->Extra.empty()) {
-        if (HasTemplateHeader)
-            OS_TemplateHeader << "extern const QMetaObject * const qt_meta_extradata_" << QualifiedClassNameIdentifier << "[];\n";
-        OS << Static << "const QMetaObject * const qt_meta_extradata_" << QualifiedClassNameIdentifier << "[] = {\n" ;
-        for (clang::CXXRecordDecl *E : Def->Extra)
-            //TODO: Check that extra is a QObject
-            OS << "    &" << E->getQualifiedNameAsString() << "::staticMetaObject,\n";
-
-        OS << "    0\n};\n";
-
+/* Emits one table with the related meta objects (the extra data) of all the Defs, and returns for
+ * each of the Defs which have some the expression pointing to its null terminated list in it.
+ * The identical lists, or the ones which are the end of another one, share the same entries.
+ */
+std::map<const BaseDef *, std::string> Generator::GenerateSharedExtraData(llvm::raw_ostream &OS,
+        const std::vector<const BaseDef *> &Defs, llvm::StringRef Name)
+{
+    std::map<const BaseDef *, std::string> Result;
+    std::vector<const BaseDef *> Sorted;
+    for (const BaseDef *Def : Defs) {
+        if (!Def->Extra.empty())
+            Sorted.push_back(Def);
     }
+    if (Sorted.empty())
+        return Result;
+    // The longest first, so the shorter ones can be found at the end of them.
+    std::stable_sort(Sorted.begin(), Sorted.end(), [](const BaseDef *A, const BaseDef *B) {
+        return A->Extra.size() > B->Extra.size();
+    });
 
-    if (IsQtNamespace) {
-        OS_TemplateHeader << "\nconst QMetaObject QObject::staticQtMetaObject = {\n"
-              "    { 0, qt_meta_stringdata_Qt.data, qt_meta_data_Qt, 0, 0, 0 }\n};\n";
-        return;
+    std::vector<clang::CXXRecordDecl *> Table; // nullptr for the terminators
+    for (const BaseDef *Def : Sorted) {
+        std::vector<clang::CXXRecordDecl *> List = Def->Extra;
+        List.push_back(nullptr);
+        auto It = std::search(Table.begin(), Table.end(), List.begin(), List.end());
+        size_t Offset = It - Table.begin();
+        if (It == Table.end())
+            Table.insert(Table.end(), List.begin(), List.end());
+        Result[Def] = Offset ? Name.str() + " + " + std::to_string(Offset) : Name.str();
     }
 
-    OS_TemplateHeader << "\n" << TemplatePrefix << "const QMetaObject " << QualName << "::staticMetaObject = {\n"
-          "    { ";
-    if (BaseName.empty() || (CDef->HasQGadget && !BaseHasStaticMetaObject)) OS_TemplateHeader << "0";
-    else OS_TemplateHeader << "&" << BaseName << "::staticMetaObject";
-
-    OS_TemplateHeader << ", qt_meta_stringdata_"<< QualifiedClassNameIdentifier <<".data,\n"
-          "      qt_meta_data_" << QualifiedClassNameIdentifier << ", ";
+    OS << "static const QMetaObject * const " << Name << "[] = {\n";
+    for (clang::CXXRecordDecl *E : Table) {
+        if (E)
+            OS << "    &" << E->getQualifiedNameAsString() << "::staticMetaObject,\n";
+        else
+            OS << "    0,\n";
+    }
+    OS << "};\n";
+    return Result;
+}
 
-    bool HasStaticMetaCall = CDef && (CDef->HasQObject || !CDef->Methods.empty() || !CDef->Properties.empty() || !CDef->Constructors.empty());
-    if (HasStaticMetaCall) OS_TemplateHeader << "qt_static_metacall, ";
-    else OS_TemplateHeader << "0, ";
+// FNV-1a. Must be the same as qt_mocng_metacast_hash in the generated code.
+static uint32_t MetaCastHash(llvm::StringRef Name)
+{
+    uint32_t H = 2166136261u;
+    for (unsigned char C : Name) {
+        H ^= C;
+        H *= 16777619u;
+    }
+    return H;
+}
 
-    if (!Def->Extra.empty()) OS_TemplateHeader << "qt_meta_extradata_" << QualifiedClassNameIdentifier << ", ";
-    else OS_TemplateHeader << "0, ";
-    OS_TemplateHeader << "0}\n};\n";
+/* qt_metacast which hashes the class name once and switches on the hash, instead of comparing
+ * it with all the names one after the other.
+ * The hashes of the class name and of the other bases are computed by moc. The interface IID
+ * are only known at runtime, so their hashes are computed the first time.
+ */
+void Generator::GenerateHashedMetaCast(llvm::StringRef ClassNameData)
+{
+    // Condition and return statement, grouped by hash in case two names have the same hash.
+    std::map<uint32_t, std::vector<std::pair<std::string, std::string>>> Cases;
+    Cases[MetaCastHash(QualName)].emplace_back(
+        "!strcmp(_clname, " + ClassNameData.str() + ")",
+        "static_cast<void*>(this)");
+    if (CDef->Record->getNumBases() > 1) {
+        for (auto BaseIt = CDef->Record->bases_begin()+1; BaseIt != CDef->Record->bases_end(); ++BaseIt) {
+            if (BaseIt->getAccessSpecifier() == clang::AS_private)
+                continue;
+            auto B = BaseIt->getType().getAsString(PrintPolicy);
+            Cases[MetaCastHash(B)].emplace_back("!qstrcmp(_clname, \"" + B + "\")",
+                                                "static_cast< " + B + "*>(this)");
+        }
+    }
 
-    if (CDef && CDef->HasQObject) {
-        OS_TemplateHeader << TemplatePrefix << "const QMetaObject *" << QualName << "::metaObject() const\n{\n"
-              "    return QObject::d_ptr->metaObject ? QObject::d_ptr->dynamicMetaObject() : &staticMetaObject;\n}\n";
+    // Guarded because several moc files may be included in the same translation unit
+    OS_TemplateHeader << "#ifndef MOCNG_METACAST_HASH\n"
+                         "#define MOCNG_METACAST_HASH\n"
+                         "static inline uint qt_mocng_metacast_hash(const char *s)\n{\n"
+                         "    uint h = 2166136261u;\n"
+                         "    while (*s) {\n"
+                         "        h ^= uchar(*s++);\n"
+                         "        h *= 16777619u;\n"
+                         "    }\n"
+                         "    return h;\n"
+                         "}\n"
+                         "#endif\n\n";
+
+    OS_TemplateHeader << TemplatePrefix << "void *" << QualName << "::qt_metacast(const char *_clname)\n{\n"
+                         "    if (!_clname) return 0;\n"
+                         "    const uint _h = qt_mocng_metacast_hash(_clname);\n"
+                         "    switch (_h) {\n";
+    for (const auto &C : Cases) {
+        OS_TemplateHeader << "    case 0x";
+        OS_TemplateHeader.write_hex(C.first) << "u:\n";
+        for (const auto &Target : C.second) {
+            OS_TemplateHeader << "        if (" << Target.first << ")\n"
+                                 "            return " << Target.second << ";\n";
+        }
+        OS_TemplateHeader << "        break;\n";
+    }
+    OS_TemplateHeader << "    }\n";
+
+    if (!CDef->Interfaces.empty()) {
+        OS_TemplateHeader << "    static const uint _iid_hashes[] = {\n";
+        for (const auto &Itrf : CDef->Interfaces)
+            OS_TemplateHeader << "        qt_mocng_metacast_hash(qobject_interface_iid< " << Itrf << " *>()),\n";
+        OS_TemplateHeader << "    };\n";
+        int I = 0;
+        for (const auto &Itrf : CDef->Interfaces) {
+            OS_TemplateHeader << "    if (_h == _iid_hashes[" << (I++) << "] && !qstrcmp(_clname, qobject_interface_iid< " << Itrf << " *>()))\n"
+                                 "        return static_cast< " << Itrf << "  *>(this);\n";
+        }
+    }
 
+    if (BaseName.empty()) OS_TemplateHeader << "    return 0;\n}\n";
+    else OS_TemplateHeader << "    return "<< BaseName <<"::qt_metacast(_clname);\n"
+               "}\n";
+}
 
-        OS_TemplateHeader <<  TemplatePrefix << "void *" << QualName << "::qt_metacast(const char *_clname)\n{\n"
-              "    if (!_clname) return 0;\n"
-              "    if (!strcmp(_clname, qt_meta_stringdata_" << QualifiedClassNameIdentifier << ".stringdata))\n"
-              "        return static_cast<void*>(this);\n";
+/* For RegisterMethodArgumentMetaType: instead of a switch with a case for each argument,
+ * generate an array with a pointer to the qt_metatype_id function of each argument, and an
+ * array with the offset in it of the first argument of each method.
+ * Only the arguments before the first one which cannot be registered are in the table, except for
+ * the private slots where such an argument has a null entry.
+ */
+void Generator::GenerateRegisterMethodArgumentTable()
+{
+    std::vector<std::string> Thunks;
+    std::vector<size_t> Offsets;
+    auto AddThunk = [&](const std::string &Type) {
+        Thunks.push_back("&QtPrivate::QMetaTypeIdHelper< " + Type + " >::qt_metatype_id");
+    };
 
-        if (CDef->Record->getNumBases() > 1) {
-            for (auto BaseIt = CDef->Record->bases_begin()+1; BaseIt != CDef->Record->bases_end(); ++BaseIt) {
-                if (BaseIt->getAccessSpecifier() == clang::AS_private)
+    auto GenerateForMethods = [&](const std::vector<clang::CXXMethodDecl*> &V) {
+        ForEachMethod(V, [&](const clang::CXXMethodDecl *MD, int Clone) {
+            Offsets.push_back(Thunks.size());
+            if (!MD->getIdentifier())
+                return;
+            int argc = MD->getNumParams() - Clone - (HasPrivateSignal(MD)?1:0);
+            for (int j = 0 ; j < argc ; ++j) {
+                auto Type = MD->getParamDecl(j)->getType();
+                if (!Moc->ShouldRegisterMetaType(Type))
+                    break;
+                AddThunk(Type.getNonReferenceType().getUnqualifiedType().getAsString(PrintPolicy));
+            }
+        });
+    };
+    GenerateForMethods(CDef->Signals);
+    GenerateForMethods(CDef->Slots);
+    for (const PrivateSlotDef &P : CDef->PrivateSlots) {
+        for (int Clone = 0; Clone <= P.NumDefault; ++Clone) {
+            Offsets.push_back(Thunks.size());
+            // We only have the type as a string: pass the const references by value, and skip the
+            // pointers (the pointee might only be forward declared) and the non-const references.
+            for (uint j = 0 ; j < P.Args.size() - Clone; ++j) {
+                llvm::StringRef Arg = llvm::StringRef(P.Args[j]).trim();
+                bool IsRef = Arg.endswith("&");
+                if (IsRef)
+                    Arg = Arg.drop_back().rtrim();
+                bool IsConst = false;
+                if (Arg.startswith("const ")) {
+                    IsConst = true;
+                    Arg = Arg.drop_front(sizeof("const ") - 1).ltrim();
+                } else if (Arg.endswith(" const")) {
+                    IsConst = true;
+                    Arg = Arg.drop_back(sizeof(" const") - 1).rtrim();
+                }
+                if (Arg.empty() || Arg.endswith("*") || Arg.endswith("&") || (IsRef && !IsConst)) {
+                    Thunks.push_back("0");
                     continue;
-                auto B = BaseIt->getType().getAsString(PrintPolicy);
-                OS_TemplateHeader << "    if (!qstrcmp(_clname, \"" << B << "\"))\n"
-                      "        return static_cast< " << B << "*>(this);\n";
+                }
+                AddThunk(Arg);
             }
         }
+    }
+    GenerateForMethods(CDef->Methods);
+    Offsets.push_back(Thunks.size());
 
-        for (const auto &Itrf : CDef->Interfaces) {
-            OS_TemplateHeader << "    if (!qstrcmp(_clname, qobject_interface_iid< " << Itrf << " *>()))\n"
-                  "        return static_cast< " << Itrf << "  *>(this);\n";
-        }
-
-        if (BaseName.empty()) OS_TemplateHeader << "    return 0;\n}\n";
-        else OS_TemplateHeader << "    return "<< BaseName <<"::qt_metacast(_clname);\n"
-                   "}\n";
+    if (Thunks.empty()) {
+        OS_TemplateHeader << "        *reinterpret_cast<int*>(_a[0]) = -1;\n";
+        return;
+    }
 
-        GenerateMetaCall();
-        GenerateStaticMetaCall();
+    OS_TemplateHeader << "        typedef int (*_f)();\n"
+                         "        static const _f _thunks[] = {\n";
+    for (const auto &T : Thunks)
+        OS_TemplateHeader << "            " << T << ",\n";
+    OS_TemplateHeader << "        };\n"
+                         "        static const uint _offsets[] = {";
+    for (size_t I = 0; I < Offsets.size(); ++I) {
+        if (I % 16 == 0)
+            OS_TemplateHeader << "\n           ";
+        OS_TemplateHeader << " " << Offsets[I] << ",";
+    }
+    OS_TemplateHeader << "\n        };\n"
+                         "        const int _arg = *reinterpret_cast<int*>(_a[1]);\n"
+                         "        const uint _i = _offsets[_id] + _arg;\n"
+                         "        *reinterpret_cast<int*>(_a[0]) = (_arg >= 0 && _i < _offsets[_id + 1] && _thunks[_i]) ? _thunks[_i]() : -1;\n";
+}
 
-        int SigIdx = 0;
-        for (const clang::CXXMethodDecl *MD : CDef->Signals) {
-            GenerateSignal(MD, SigIdx);
-            SigIdx += 1 + MD->getNumParams() - MD->getMinRequiredArguments();
+/* For --member-table: in a standard layout class, the MEMBER properties without READ function
+ * whose member is a trivially copyable field of the class, of the same type as the property, can
+ * be read and written with a memcpy at an offset within the object.
+ * Emits the _members table (at the beginning of qt_static_metacall) and returns, for each
+ * property, whether it can be read (1) and written (2) through it.
+ */
+std::vector<unsigned> Generator::GenerateMemberPropertyTable()
+{
+    std::vector<unsigned> Flags(CDef->Properties.size());
+    // Not for templates: offsetof is a macro and the class name might contain commas.
+    // offsetof is only supported on standard layout classes (so never on a QObject): the others
+    // keep the switch.
+    if (CDef->Properties.empty() || CDef->Record->getDescribedClassTemplate()
+            || !CDef->Record->isStandardLayout())
+        return Flags;
+
+    std::vector<const clang::FieldDecl *> Fields(CDef->Properties.size());
+    bool Any = false;
+    for (uint I = 0; I < CDef->Properties.size(); ++I) {
+        const PropertyDef &P = CDef->Properties[I];
+        if (P.member.empty() || !P.read.empty() || !P.inPrivateClass.empty() || P.PointerHack)
+            continue;
+        for (auto F = CDef->Record->field_begin(); F != CDef->Record->field_end(); ++F) {
+            if (F->getName() != P.member)
+                continue;
+            clang::QualType T = F->getType();
+#if CLANG_VERSION_MAJOR == 3 && CLANG_VERSION_MINOR < 8
+            bool TriviallyCopyable = T->isTriviallyCopyableType(Ctx);
+#else
+            bool TriviallyCopyable = T.isTriviallyCopyableType(Ctx);
+#endif
+            if (F->isBitField() || T->isDependentType() || T.isVolatileQualified() || !TriviallyCopyable
+                    || T.getUnqualifiedType().getAsString(PrintPolicy) != P.type)
+                break;
+            Fields[I] = *F;
+            Flags[I] = 1;
+            // Setting a property with NOTIFY needs to compare and emit the signal.
+            if (P.write.empty() && !P.constant && P.notify.Str.empty() && !T.isConstQualified())
+                Flags[I] |= 2;
+            Any = true;
+            break;
         }
-    } else if (HasStaticMetaCall) {
-        GenerateStaticMetaCall();
     }
+    if (!Any)
+        return Flags;
 
-    if (CDef && !CDef->Plugin.IID.empty()) {
-        OS << "\nQT_PLUGIN_METADATA_SECTION const uint qt_section_alignment_dummy = 42;\n"
-              "#ifdef QT_NO_DEBUG\n";
-        GeneratePluginMetaData(false);
-        OS << "#else\n";
-        GeneratePluginMetaData(true);
-        OS << "#endif\n";
-
-        OS << "QT_MOC_EXPORT_PLUGIN(" << QualName << ", " << CDef->Record->getName() << ")\n\n";
+    llvm::StringRef ClassName = CDef->Record->getName();
+    OS_TemplateHeader << "    static const struct { uint offset; uint size; uint flags; } _members[] = {\n";
+    for (uint I = 0; I < Fields.size(); ++I) {
+        if (!Fields[I]) {
+            OS_TemplateHeader << "        { 0, 0, 0 },\n";
+            continue;
+        }
+        OS_TemplateHeader << "        { offsetof(" << ClassName << ", " << Fields[I]->getName()
+                          << "), sizeof(" << CDef->Properties[I].type << "), " << Flags[I] << " },\n";
     }
+    OS_TemplateHeader << "    };\n";
+    return Flags;
 }
 
 void Generator::GenerateMetaCall()
@@ -792,6 +1253,7 @@ void Generator::GenerateMetaCall()
                 OS_TemplateHeader << "        switch (_id) {\n";
                 int I = 0;
                 for (const PropertyDef &p : CDef->Properties) {
+                    Stats.MetaCallCases++;
                     OS_TemplateHeader << "        case " << (I++) <<": ";
                     const std::string &S = (p.*A);
                     if (!S.empty() && S[S.size()-1] == ')')
@@ -819,7 +1281,11 @@ void Generator::GenerateStaticMetaCall()
 {
     llvm::StringRef ClassName = CDef->Record->getName();
     OS_TemplateHeader << "\n" <<  TemplatePrefix << "void " << QualName
-        << "::qt_static_metacall(QObject *_o, QMetaObject::Call _c, int _id, void **_a)\n{\n    ";
+        << "::qt_static_metacall(QObject *_o, QMetaObject::Call _c, int _id, void **_a)\n{\n";
+    std::vector<unsigned> MemberTableFlags;
+    if (MemberPropertyTable)
+        MemberTableFlags = GenerateMemberPropertyTable();
+    OS_TemplateHeader << "    ";
     bool NeedElse = false;
 
     if (!CDef->Constructors.empty()) {
@@ -830,6 +1296,7 @@ void Generator::GenerateStaticMetaCall()
 
         int CtorIndex = 0;
         ForEachMethod(CDef->Constructors, [&](const clang::CXXConstructorDecl *MD, int C) {
+            Stats.StaticMetaCallCases++;
             OS_TemplateHeader << "        case " << (CtorIndex++) << ": { " << resultType << " *_r = new " << ClassName << "(";
 
             for (uint j = 0 ; j < MD->getNumParams() - C; ++j) {
@@ -865,6 +1332,7 @@ void Generator::GenerateStaticMetaCall()
             if (!MD->getIdentifier())
                 return;
 
+            Stats.StaticMetaCallCases++;
             OS_TemplateHeader << "        case " << MethodIndex << ": ";
             MethodIndex++;
 
@@ -909,6 +1377,7 @@ void Generator::GenerateStaticMetaCall()
         ForEachMethod(CDef->Slots, GenerateInvokeMethod);
         for (const PrivateSlotDef &P : CDef->PrivateSlots) {
             for (int Clone = 0; Clone <= P.NumDefault; ++Clone) {
+                Stats.StaticMetaCallCases++;
                 OS_TemplateHeader << "        case " << MethodIndex << ": ";
                 // Original moc don't support reference as return type: see  Moc::parseFunction
                 bool IsVoid = P.ReturnType == "void" || P.ReturnType.empty() || P.ReturnType.back() == '&';
@@ -930,38 +1399,44 @@ void Generator::GenerateStaticMetaCall()
         ForEachMethod(CDef->Methods, GenerateInvokeMethod);
         OS_TemplateHeader << "        default: break;\n"
               "        }\n"
-              "    } else if (_c == QMetaObject::RegisterMethodArgumentMetaType) {\n"
-              "        switch ((_id << 16) | *reinterpret_cast<int*>(_a[1])) {\n"
-              "        default: *reinterpret_cast<int*>(_a[0]) = -1; break;\n";
+              "    } else if (_c == QMetaObject::RegisterMethodArgumentMetaType) {\n";
+        if (TableRegisterMetaTypes) {
+            GenerateRegisterMethodArgumentTable();
+        } else {
+            OS_TemplateHeader << "        switch ((_id << 16) | *reinterpret_cast<int*>(_a[1])) {\n"
+                  "        default: *reinterpret_cast<int*>(_a[0]) = -1; break;\n";
 
 
-        MethodIndex = 0;
-        auto GenerateRegisterMethodArguments = [&](const clang::CXXMethodDecl *MD, int Clone) {
-            if (!MD->getIdentifier()) {
+            MethodIndex = 0;
+            auto GenerateRegisterMethodArguments = [&](const clang::CXXMethodDecl *MD, int Clone) {
+                if (!MD->getIdentifier()) {
+                    MethodIndex++;
+                    return;
+                }
+              //  RegisterT(getResultType(MD), (MethodIndex << 16));
+                int argc = MD->getNumParams() - Clone - (HasPrivateSignal(MD)?1:0);
+                for (int j = 0 ; j < argc ; ++j) {
+                    auto Type = MD->getParamDecl(j)->getType();
+                    if (!Moc->ShouldRegisterMetaType(Type))
+                        break;
+                    Stats.StaticMetaCallCases++;
+                    OS_TemplateHeader << "       case 0x";
+                    OS_TemplateHeader.write_hex((MethodIndex << 16) | j);
+                    OS_TemplateHeader << ": *reinterpret_cast<int*>(_a[0]) = ";
+                    OS_TemplateHeader <<  "QtPrivate::QMetaTypeIdHelper< " << Type.getNonReferenceType().getUnqualifiedType().getAsString(PrintPolicy)
+                        << " >::qt_metatype_id(); break;\n";
+                }
                 MethodIndex++;
-                return;
-            }
-          //  RegisterT(getResultType(MD), (MethodIndex << 16));
-            int argc = MD->getNumParams() - Clone - (HasPrivateSignal(MD)?1:0);
-            for (int j = 0 ; j < argc ; ++j) {
-                auto Type = MD->getParamDecl(j)->getType();
-                if (!Moc->ShouldRegisterMetaType(Type))
-                    break;
-                OS_TemplateHeader << "       case 0x";
-                OS_TemplateHeader.write_hex((MethodIndex << 16) | j);
-                OS_TemplateHeader << ": *reinterpret_cast<int*>(_a[0]) = ";
-                OS_TemplateHeader <<  "QtPrivate::QMetaTypeIdHelper< " << Type.getNonReferenceType().getUnqualifiedType().getAsString(PrintPolicy)
-                    << " >::qt_metatype_id(); break;\n";
-            }
-            MethodIndex++;
-        };
+            };
 
-        ForEachMethod(CDef->Signals, GenerateRegisterMethodArguments);
-        ForEachMethod(CDef->Slots, GenerateRegisterMethodArguments);
-        MethodIndex += CDef->PrivateSlotCount; // TODO: we should also register these types.
-        ForEachMethod(CDef->Methods, GenerateRegisterMethodArguments);
+            ForEachMethod(CDef->Signals, GenerateRegisterMethodArguments);
+            ForEachMethod(CDef->Slots, GenerateRegisterMethodArguments);
+            MethodIndex += CDef->PrivateSlotCount; // TODO: we should also register these types.
+            ForEachMethod(CDef->Methods, GenerateRegisterMethodArguments);
 
-        OS_TemplateHeader << "        }\n    }";
+            OS_TemplateHeader << "        }\n";
+        }
+        OS_TemplateHeader << "    }";
 
     }
     if (!CDef->Signals.empty()) {
@@ -988,6 +1463,7 @@ void Generator::GenerateStaticMetaCall()
             OS_TemplateHeader <<
                   "            if (*reinterpret_cast<_t *>(func) == static_cast<_t>(&"<< ClassName <<"::"<< MD->getName() <<")) {\n"
                   "                *result = " << Idx << ";\n"
+                  "                return;\n"
                   "            }\n"
                   "        }\n";
         }
@@ -1013,9 +1489,11 @@ void Generator::GenerateStaticMetaCall()
 
 
         // Generate the code for QMetaObject::'Action'.  calls 'Functor' to generate the  code for
-        // each properties
+        // each properties, except the ones with TableFlag in MemberTableFlags which are copied
+        // using the _members table.
         auto HandlePropertyAction = [&](bool Need, const char *Action,
-                                        const std::function<void(const PropertyDef &)> &Functor) {
+                                        const std::function<void(const PropertyDef &)> &Functor,
+                                        unsigned TableFlag = 0) {
             OS_TemplateHeader << "if (_c == QMetaObject::" << Action << ") {\n";
             if (Need) {
                 if (CDef->HasQObject) {
@@ -1024,9 +1502,28 @@ void Generator::GenerateStaticMetaCall()
                 } else {
                     OS_TemplateHeader << "        " << ClassName <<" *_t = reinterpret_cast<" << ClassName << " *>(_o);\n";
                 }
-                OS_TemplateHeader << "        switch (_id) {\n";
+                bool UseTable = std::any_of(MemberTableFlags.begin(), MemberTableFlags.end(),
+                                            [&](unsigned F) { return F & TableFlag; });
+                if (UseTable) {
+                    OS_TemplateHeader << "        if (uint(_id) < " << CDef->Properties.size()
+                                      << " && (_members[_id].flags & " << TableFlag << ")) {\n"
+                                         "            char *_m = reinterpret_cast<char *>(_t) + _members[_id].offset;\n";
+                    if (TableFlag == 1)
+                        OS_TemplateHeader << "            ::memcpy(_a[0], _m, _members[_id].size);\n";
+                    else
+                        OS_TemplateHeader << "            ::memcpy(_m, _a[0], _members[_id].size);\n";
+                    OS_TemplateHeader << "        } else ";
+                } else {
+                    OS_TemplateHeader << "        ";
+                }
+                OS_TemplateHeader << "switch (_id) {\n";
                 int I = 0;
                 for (const PropertyDef &p : CDef->Properties) {
+                    if (UseTable && (MemberTableFlags[I] & TableFlag)) {
+                        I++;
+                        continue;
+                    }
+                    Stats.StaticMetaCallCases++;
                     OS_TemplateHeader << "        case " << (I++) <<": ";
                     Functor(p);
                     OS_TemplateHeader << "break;\n";
@@ -1057,7 +1554,7 @@ void Generator::GenerateStaticMetaCall()
               else
                   OS_TemplateHeader << p.member << "; ";
             }
-        });
+        }, 1);
         OS_TemplateHeader << " else ";
         HandlePropertyAction(needSet, "WriteProperty", [&](const PropertyDef &p) {
             if (p.constant)
@@ -1087,7 +1584,7 @@ void Generator::GenerateStaticMetaCall()
                     OS_TemplateHeader << M << " = " << A << "; ";
                 }
             }
-        });
+        }, 2);
         OS_TemplateHeader << " else ";
         HandlePropertyAction(needReset, "ResetProperty", [&](const PropertyDef &p) {
             if (p.reset.empty() || p.reset[p.reset.size()-1] != ')')
@@ -1115,6 +1612,7 @@ void Generator::GenerateStaticMetaCall()
                 } ))
                     continue;
             }
+            Stats.StaticMetaCallCases++;
             OS_TemplateHeader << "        case " << OldIdx << ": *reinterpret_cast<int*>(_a[0]) = QtPrivate::QMetaTypeIdHelper<"
                << P.type << " >::qt_metatype_id(); break;\n";
         }
@@ -1159,6 +1657,9 @@ void Generator::GenerateSignal(const clang::CXXMethodDecl *MD, int Idx)
     OS_TemplateHeader << "\n{\n";
     bool IsVoid = ReturnType->isVoidType();
     unsigned int NumParam = MD->getNumParams();
+
+    // No early return when nothing is connected: QMetaObject::activate already checks the
+    // connection bitmap without locking, and it must still be called for the signal spy hooks.
     if (IsVoid && NumParam == 0) {
         OS_TemplateHeader << "    QMetaObject::activate(" << This << ", &staticMetaObject, " << Idx << ", 0);\n";
     } else {
@@ -1242,7 +1743,9 @@ void Generator::GenerateProperties()
             flags |= Constant;
         if (p.final)
             flags |= Final;
-        OS << "    " << StrIdx(p.name) << ", 0x80000000 | " << StrIdx(p.type) << ", 0x";
+        OS << "    " << StrIdx(p.name) << ", ";
+        GenerateTypeInfo(p.type);
+        OS << ", 0x";
         OS.write_hex(flags) << ", // " << p.name << "\n";
     }
 
@@ -1304,12 +1807,36 @@ void Generator::GenerateEnums(int EnumIndex)
 // Register the string if it is not yet registered.
 int Generator::StrIdx(llvm::StringRef Str)
 {
-    std::string S = Str;
-    auto It = std::find(Strings.begin(), Strings.end(), S);
-    if (It != Strings.end())
-        return It - Strings.begin();
-    Strings.push_back(std::move(S));
-    return Strings.size() - 1;
+    if (SharedStrings) {
+        OwnStrings.Add(Str); // only for the Stats
+        return SharedStrings->Add(Str);
+    }
+    return OwnStrings.Add(Str);
+}
+
+int MetaStringTable::Add(llvm::StringRef Str)
+{
+#if CLANG_VERSION_MAJOR == 3 && CLANG_VERSION_MINOR <= 5
+    auto &Entry = Index.GetOrCreateValue(Str, -1);
+    if (Entry.getValue() < 0) {
+        Entry.setValue(Strings.size());
+        Strings.push_back(Entry.getKey());
+    }
+    return Entry.getValue();
+#else
+    auto It = Index.insert(std::make_pair(Str, int(Strings.size())));
+    if (It.second)
+        Strings.push_back(It.first->getKey());
+    return It.first->second;
+#endif
+}
+
+int MetaStringTable::Offset(int Idx) const
+{
+    int Ofs = 0;
+    for (int I = 0; I < Idx; ++I)
+        Ofs += Strings[I].size() + 1;
+    return Ofs;
 }
 
 void Generator::GeneratePluginMetaData(bool Debug)
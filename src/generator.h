@@ -19,6 +19,7 @@
 
 #pragma once
 
+#include <map>
 #include <string>
 #include <vector>
 
@@ -30,6 +31,7 @@ class QualType;
 }
 
 #include <clang/AST/PrettyPrinter.h>
+#include <llvm/ADT/StringMap.h>
 #include "mocng.h"
 
 struct ClassDef;
@@ -94,13 +96,35 @@ enum { OutputRevision = 7,
 
 #define MOCNG_VERSION_STR "alpha 1"
 
+// The strings of the string data of a meta object, or of several if they share it (--shared-strings)
+struct MetaStringTable {
+    // The strings, in order. They point to the keys of Index
+    std::vector<llvm::StringRef> Strings;
+    llvm::StringMap<int> Index;
+
+    // Returns the index of the string, and adds it if it is not yet in the table
+    int Add(llvm::StringRef Str);
+    // Offset of the string in the char array
+    int Offset(int Idx) const;
+};
+
+// Size of the generated code of a class (--size-report)
+struct ClassSizeStats {
+    std::string ClassName;
+    unsigned DataBytes = 0; // qt_meta_data
+    unsigned StringCount = 0;
+    unsigned StringBytes = 0; // QByteArrayData and characters of the strings of the class
+    unsigned StaticMetaCallCases = 0; // cases of the switches in qt_static_metacall
+    unsigned MetaCallCases = 0; // cases of the switches in qt_metacall
+};
+
 class Generator {
     const BaseDef *Def;
     const ClassDef *CDef;
     llvm::raw_ostream& OS;
     llvm::raw_ostream& OS_TemplateHeader;
 
-    std::vector<std::string> Strings;
+    MetaStringTable OwnStrings;
 
     std::string QualName;
     std::string BaseName;
@@ -122,10 +146,39 @@ public:
 
     bool IsQtNamespace = false;
 
+    // Generate a qt_metacast that switches on the hash of the class name (--metacast-hash)
+    bool HashedMetaCast = false;
+    // Generate tables instead of a switch for RegisterMethodArgumentMetaType (--metatype-table)
+    bool TableRegisterMetaTypes = false;
+    // Read and write the MEMBER properties of standard layout classes with a memcpy from a table of
+    // offsets (--member-table)
+    bool MemberPropertyTable = false;
+
+    // Let the compiler compute the offsets of the strings and check the layout of the data,
+    // which is constexpr (--constexpr-data)
+    bool ConstexprData = false;
+
+    // When set, the expression pointing to the related meta objects of the class in the table
+    // generated with GenerateSharedExtraData (--shared-extradata)
+    std::string SharedExtraData;
+
+    // When set, the strings go to this table instead of one for this class. Its string data must
+    // then be generated, with the name SharedStringsName, before the code of the class.
+    MetaStringTable *SharedStrings = nullptr;
+    std::string SharedStringsName;
+
     // plugin metadata from -M command line argument  (to be put in the JSON)
     std::vector<std::pair<llvm::StringRef, llvm::StringRef>> MetaData;
 
     void GenerateCode();
+    // Filled by GenerateCode
+    ClassSizeStats Stats;
+
+    static void GenerateStringData(llvm::raw_ostream &OS, llvm::raw_ostream &OS_TemplateHeader,
+                                   const MetaStringTable &Table, llvm::StringRef Name,
+                                   bool HasTemplateHeader, bool StringMembers);
+    static std::map<const BaseDef *, std::string> GenerateSharedExtraData(llvm::raw_ostream &OS,
+            const std::vector<const BaseDef *> &Defs, llvm::StringRef Name);
 private:
 
     int StrIdx(llvm::StringRef);
@@ -138,8 +191,13 @@ private:
     void GenerateMetaCall();
     void GenerateStaticMetaCall();
     void GenerateSignal(const clang::CXXMethodDecl *MD, int Idx);
+    void GenerateHashedMetaCast(llvm::StringRef ClassNameData);
+    void GenerateRegisterMethodArgumentTable();
+    std::vector<unsigned> GenerateMemberPropertyTable();
 
+    const char *BuiltinMetaTypeForName(llvm::StringRef TypeName);
     void GenerateTypeInfo(clang::QualType Type);
+    void GenerateTypeInfo(llvm::StringRef TypeName);
     void GenerateEnums(int EnumIndex);
     void GeneratePluginMetaData(bool Debug);
 
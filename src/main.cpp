@@ -29,49 +29,140 @@
 #include <clang/Driver/Job.h>
 #include "clang/Frontend/TextDiagnosticPrinter.h"
 #include <clang/Lex/Preprocessor.h>
+#include <clang/Lex/Lexer.h>
 #include <clang/AST/ASTContext.h>
 #include <clang/AST/DeclCXX.h>
+#include <clang/Basic/Version.h>
 #include <llvm/Support/Host.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/Format.h>
+#include <llvm/Support/MD5.h>
+#include <llvm/Support/Path.h>
+#if CLANG_VERSION_MAJOR != 3
+#include <llvm/Support/Chrono.h>
+#endif
 
+#include <algorithm>
+#include <cctype>
 #include <vector>
 #include <iostream>
+#include <fstream>
+#include <map>
+#include <set>
+#include <iterator>
+#include <sstream>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <thread>
 
 #include "mocastconsumer.h"
 #include "generator.h"
 #include "mocppcallbacks.h"
 #include "embedded_includes.h"
+#include "server.h"
+
+// The sizes of the generated classes, collected from all the jobs (--size-report)
+struct SizeReport {
+  std::mutex Mutex;
+  std::vector<std::pair<std::string, ClassSizeStats>> Classes; // input file and sizes of a class
+  bool write(const std::string &FileName);
+};
+
+/* Where a run of moc resolves the relative paths and writes its messages.
+ * For a request to the server, these are the ones of the client: the server never changes its
+ * working directory or its standard streams, as it serves several clients at the same time.
+ */
+struct MocEnvironment {
+  std::string WorkingDir; // absolute
+  llvm::raw_ostream &Out; // the output when it is "-"
+  llvm::raw_ostream &Err; // the messages and the diagnostics
+  std::string absolute(llvm::StringRef Path) const {
+    if (Path.empty() || Path == "-" || llvm::sys::path::is_absolute(Path))
+      return Path.str();
+    llvm::SmallString<256> Result(WorkingDir);
+    llvm::sys::path::append(Result, Path);
+    return Result.str().str();
+  }
+};
 
 struct MocOptions {
   bool NoInclude = false;
   std::vector<std::string> Includes;
-  std::string Output;
-  std::string OutputTemplateHeader;
+  std::string Output; // absolute path, or "-"
+  std::string OutputTemplateHeader; // absolute path
+  std::string DepFileTarget; // the output as given on the command line (or -MT), for the depfile
   std::vector<std::pair<llvm::StringRef, llvm::StringRef>> MetaData;
-  void addOutput(llvm::StringRef);
-} Options;
+  std::string CacheDir; // output cache (--cache-dir), empty if disabled
+  bool WriteIfChanged = false; // do not touch the output files if their content is the same
+  std::string DepFile; // where to write the dependencies of the output (-MD/-MF), empty if disabled
+  bool Prescan = false; // skip the headers that do not contain any Qt macros without parsing them (--prescan)
+  bool HashedMetaCast = false; // see Generator::HashedMetaCast
+  bool TableRegisterMetaTypes = false; // see Generator::TableRegisterMetaTypes
+  bool MemberPropertyTable = false; // see Generator::MemberPropertyTable
+  bool SharedStrings = false; // one string data for all the classes of the file
+  bool ConstexprData = false; // see Generator::ConstexprData
+  bool SharedExtraData = false; // one table of related meta objects for all the classes of the file
+  SizeReport *Sizes = nullptr; // where to report the sizes of the classes, if not null
+  unsigned SizeBudget = 0; // warn about the classes whose meta data is bigger, in bytes (0 to disable)
+  const MocEnvironment *Env = nullptr;
+  bool addOutput(llvm::StringRef);
+  // Hash what, besides the input, changes the generated code.
+  void hash(llvm::MD5 &Hash) const;
+};
 
-void MocOptions::addOutput(llvm::StringRef Out)
+void MocOptions::hash(llvm::MD5 &Hash) const
+{
+    auto Add = [&](llvm::StringRef Str) {
+        Hash.update(Str);
+        Hash.update(llvm::StringRef("", 1)); // separator
+    };
+    Add(NoInclude ? "1" : "0");
+    for (const auto &I : Includes)
+        Add(I);
+    Add("");
+    for (const auto &M : MetaData) {
+        Add(M.first);
+        Add(M.second);
+    }
+    Add("");
+    Add(OutputTemplateHeader.empty() ? "0" : "1");
+    Add(HashedMetaCast ? "1" : "0");
+    Add(TableRegisterMetaTypes ? "1" : "0");
+    Add(MemberPropertyTable ? "1" : "0");
+    Add(SharedStrings ? "1" : "0");
+    Add(ConstexprData ? "1" : "0");
+    Add(SharedExtraData ? "1" : "0");
+}
+
+// Returns false if there are too many outputs
+bool MocOptions::addOutput(llvm::StringRef Out)
 {
     if (Output.empty()) {
         Output = Out.str();
     } else if (OutputTemplateHeader.empty()) {
         OutputTemplateHeader = Out.str();
     } else {
-        std::cerr << "moc-ng: Too many output file specified" << std::endl;
+        return false;
     }
+    return true;
 }
 
 
 /* Proxy that changes some errors into warnings  */
 struct MocDiagConsumer : clang::DiagnosticConsumer {
-    std::unique_ptr<DiagnosticConsumer> Proxy;
-    MocDiagConsumer(std::unique_ptr<DiagnosticConsumer> Previous) : Proxy(std::move(Previous))  {}
+    DiagnosticConsumer *Proxy;
+    std::unique_ptr<DiagnosticConsumer> OwnedProxy; // null if the previous client was not owned
+    MocDiagConsumer(std::unique_ptr<DiagnosticConsumer> Previous)
+        : Proxy(Previous.get()), OwnedProxy(std::move(Previous)) {}
+    MocDiagConsumer(DiagnosticConsumer *Previous) : Proxy(Previous) {}
 
     int HadRealError = 0;
 
 #if CLANG_VERSION_MAJOR == 3 && CLANG_VERSION_MINOR <= 2
     DiagnosticConsumer* clone(clang::DiagnosticsEngine& Diags) const override {
-        return new MocDiagConsumer { Proxy->clone(Diags) };
+        return new MocDiagConsumer { std::unique_ptr<DiagnosticConsumer>(Proxy->clone(Diags)) };
     }
 #endif
     void BeginSourceFile(const clang::LangOptions& LangOpts, const clang::Preprocessor* PP = 0) override {
@@ -121,19 +212,68 @@ struct MocDiagConsumer : clang::DiagnosticConsumer {
 
 
 
+static bool ReadFile(const std::string &Path, std::string &Content)
+{
+    std::ifstream In(Path, std::ios::binary);
+    if (!In)
+        return false;
+    Content.assign(std::istreambuf_iterator<char>(In), std::istreambuf_iterator<char>());
+    return !In.bad();
+}
+
+// Write to a temporary file which is then renamed, so other processes never see a partial file.
+static bool WriteFileAtomically(const std::string &Path, llvm::StringRef Content)
+{
+    llvm::SmallString<128> TempFile;
+    int FD;
+    if (llvm::sys::fs::createUniqueFile(Path + "-%%%%%%%%.tmp", FD, TempFile))
+        return false;
+    {
+        llvm::raw_fd_ostream OS(FD, /*shouldClose=*/true);
+        OS << Content;
+    }
+    if (llvm::sys::fs::rename(TempFile, Path)) {
+        llvm::sys::fs::remove(TempFile);
+        return false;
+    }
+    return true;
+}
+
+// Only write the file if the content is different, so the timestamp does not change
+static bool UpdateFile(const std::string &Path, llvm::StringRef Content)
+{
+    std::string Existing;
+    if (ReadFile(Path, Existing) && Existing == Content)
+        return true;
+    return WriteFileAtomically(Path, Content);
+}
+
 struct MocNGASTConsumer : public MocASTConsumer {
     std::string InFile;
-    MocNGASTConsumer(clang::CompilerInstance& ci, llvm::StringRef InFile) : MocASTConsumer(ci), InFile(InFile) { }
+    const MocOptions &Options;
+    std::vector<std::string> *Dependencies;
+    std::vector<std::string> *AbsentFiles;
+    const std::vector<std::string> &PrecompiledTags;
+    MocNGASTConsumer(clang::CompilerInstance& ci, llvm::StringRef InFile, const MocOptions &Options,
+                     std::vector<std::string> *Dependencies, std::vector<std::string> *AbsentFiles,
+                     const std::vector<std::string> &PrecompiledTags)
+        : MocASTConsumer(ci), InFile(InFile), Options(Options), Dependencies(Dependencies),
+          AbsentFiles(AbsentFiles), PrecompiledTags(PrecompiledTags) { }
 
 
-#if CLANG_VERSION_MAJOR == 3 && CLANG_VERSION_MINOR < 8
-    // Clang 3.8 changed when Initialize is called. It is now called before the main file has been entered.
-    // But with Clang < 3.8 it is called after, and PPCallbacks::FileChanged is not called when entering the main file
     void Initialize(clang::ASTContext& Ctx) override {
         MocASTConsumer::Initialize(Ctx);
+        PPCallbacks->Dependencies = Dependencies;
+        PPCallbacks->AbsentFiles = AbsentFiles;
+        // The macros defined within Q_MOC_RUN in the precompiled header were not seen by PPCallbacks
+        for (const auto &Name : PrecompiledTags)
+            PPCallbacks->AddPossibleTag(Name);
+#if CLANG_VERSION_MAJOR == 3 && CLANG_VERSION_MINOR < 8
+        // Clang 3.8 changed when Initialize is called. It is now called before the main file has been entered.
+        // But with Clang < 3.8 it is called after, and PPCallbacks::FileChanged is not called when entering the main file
         PPCallbacks->EnterMainFile(InFile);
-    }
 #endif
+    }
 
     bool shouldParseDecl(clang::Decl * D) override {
         // We only want to parse the Qt macro in classes that are in the main file.
@@ -149,20 +289,40 @@ struct MocNGASTConsumer : public MocASTConsumer {
         if (ci.getDiagnostics().hasErrorOccurred())
             return;
 
+        CollectPrecompiledMetaTypes();
+
         if (!objects.size() && !namespaces.size()) {
           ci.getDiagnostics().Report(ci.getSourceManager().getLocForStartOfFile(ci.getSourceManager().getMainFileID()),
                                      ci.getDiagnostics().getCustomDiagID(clang::DiagnosticsEngine::Warning,
                                                                          "No relevant classes found. No output generated"));
           //actually still create an empty file like moc does.
-          ci.createOutputFile(Options.Output, false, true, "", "", false, false);
+          if (Options.Output == "-")
+              return;
+          if (Options.WriteIfChanged)
+              WriteOutput(Options.Output, "");
+          else
+              ci.createOutputFile(Options.Output, false, true, "", "", false, false);
           return;
         }
 
         // createOutputFile returns a raw_pwrite_stream* before Clang 3.9, and a std::unique_ptr<raw_pwrite_stream> after
-        auto OS = ci.createOutputFile(Options.Output, false, true, "", "", false, false);
+        decltype(ci.createOutputFile("", false, true, "", "", false, false)) OS = nullptr, OS_TemplateFile = nullptr;
+        // With WriteIfChanged, generate in memory, and compare with the existing file at the end.
+        std::string Buffer, TemplateBuffer;
+        llvm::raw_string_ostream BufferOS(Buffer), TemplateBufferOS(TemplateBuffer);
+        auto OpenOutput = [&](const std::string &Path, decltype(OS) &File,
+                              llvm::raw_string_ostream &BufferOS) -> llvm::raw_ostream * {
+            if (Path == "-")
+                return &Options.Env->Out;
+            if (Options.WriteIfChanged)
+                return &BufferOS;
+            File = ci.createOutputFile(Path, false, true, "", "", false, false);
+            return File ? &*File : nullptr;
+        };
 
-        if (!OS) return;
-        llvm::raw_ostream &Out = *OS;
+        llvm::raw_ostream *OutPtr = OpenOutput(Options.Output, OS, BufferOS);
+        if (!OutPtr) return;
+        llvm::raw_ostream &Out = *OutPtr;
 
         auto WriteHeader = [&](llvm::raw_ostream & Out) {
             Out <<  "/****************************************************************************\n"
@@ -201,10 +361,9 @@ struct MocNGASTConsumer : public MocASTConsumer {
                "QT_WARNING_PUSH QT_WARNING_DISABLE_DEPRECATED\n"
                "#endif\n";
 
-        decltype(OS) OS_TemplateHeader = nullptr;
+        llvm::raw_ostream *OS_TemplateHeader = nullptr;
         if (!Options.OutputTemplateHeader.empty()) {
-            OS_TemplateHeader =
-                ci.createOutputFile(Options.OutputTemplateHeader, false, true, "", "", false, false);
+            OS_TemplateHeader = OpenOutput(Options.OutputTemplateHeader, OS_TemplateFile, TemplateBufferOS);
             if (!OS_TemplateHeader)
                 return;
             WriteHeader(*OS_TemplateHeader);
@@ -214,20 +373,98 @@ struct MocNGASTConsumer : public MocASTConsumer {
                "#endif\n";
         }
 
-        for (const ClassDef &Def : objects ) {
-          Generator G(&Def, Out, Ctx, &Moc,
-                      Def.Record->getDescribedClassTemplate() ? &*OS_TemplateHeader : nullptr);
+        // With --shared-strings, the code of the classes is buffered as the shared string data
+        // needs to come first, and is only known once all the classes are generated.
+        MetaStringTable SharedStrings;
+        std::string ClassCode;
+        llvm::raw_string_ostream ClassCodeOS(ClassCode);
+        llvm::raw_ostream &ClassOut = Options.SharedStrings ? ClassCodeOS : Out;
+
+        // Suffix for the names of the shared tables. Unique for this file, as several moc files
+        // may be included in the same translation unit (e.g. the mocs_compilation.cpp of
+        // AUTOMOC), even for headers with the same name in different directories: the file name
+        // is followed by a hash of the full path.
+        std::string FileIdentifier = llvm::sys::path::filename(InFile).str();
+        for (char &C : FileIdentifier) {
+            if (!std::isalnum(static_cast<unsigned char>(C)))
+                C = '_';
+        }
+        {
+            llvm::MD5 Hash;
+            Hash.update(Options.Env->absolute(InFile));
+            llvm::MD5::MD5Result Result;
+            Hash.final(Result);
+            llvm::SmallString<32> Hex;
+            llvm::MD5::stringifyResult(Result, Hex);
+            FileIdentifier += "_" + Hex.substr(0, 8).str();
+        }
+
+        // With --shared-extradata, the related meta objects of all the classes of the file are
+        // in one table, generated before the classes.
+        std::map<const BaseDef *, std::string> SharedExtraData;
+        if (Options.SharedExtraData) {
+            std::vector<const BaseDef *> Defs;
+            for (const ClassDef &Def : objects) {
+                if (!Def.Record->getDescribedClassTemplate() || !OS_TemplateHeader)
+                    Defs.push_back(&Def);
+            }
+            for (const NamespaceDef &Def : namespaces)
+                Defs.push_back(&Def);
+            SharedExtraData = Generator::GenerateSharedExtraData(Out, Defs,
+                                    "qt_meta_extradata_shared_" + FileIdentifier);
+        }
+
+        auto SetupGenerator = [&](Generator &G, const BaseDef *Def) {
           G.MetaData = Options.MetaData;
+          G.ConstexprData = Options.ConstexprData;
+          if (Options.SharedStrings) {
+            G.SharedStrings = &SharedStrings;
+            G.SharedStringsName = "qt_meta_stringdata_shared_" + FileIdentifier;
+          }
+          auto It = SharedExtraData.find(Def);
+          if (It != SharedExtraData.end())
+            G.SharedExtraData = It->second;
+        };
+
+        auto CheckSize = [&](const ClassSizeStats &Stats, clang::SourceLocation Loc) {
+          unsigned Size = Stats.DataBytes + Stats.StringBytes;
+          if (Options.SizeBudget && Size > Options.SizeBudget) {
+            ci.getDiagnostics().Report(Loc, ci.getDiagnostics().getCustomDiagID(clang::DiagnosticsEngine::Warning,
+                "the meta data of '%0' takes %1 bytes, which exceeds the budget of %2 bytes"))
+                << Stats.ClassName << Size << Options.SizeBudget;
+          }
+          if (Options.Sizes) {
+            std::lock_guard<std::mutex> Lock(Options.Sizes->Mutex);
+            Options.Sizes->Classes.emplace_back(InFile, Stats);
+          }
+        };
+
+        for (const ClassDef &Def : objects ) {
+          Generator G(&Def, ClassOut, Ctx, &Moc,
+                      Def.Record->getDescribedClassTemplate() ? OS_TemplateHeader : nullptr);
+          SetupGenerator(G, &Def);
+          G.HashedMetaCast = Options.HashedMetaCast;
+          G.TableRegisterMetaTypes = Options.TableRegisterMetaTypes;
+          G.MemberPropertyTable = Options.MemberPropertyTable;
           if (llvm::StringRef(InFile).endswith("global/qnamespace.h"))
               G.IsQtNamespace = true;
           G.GenerateCode();
+          CheckSize(G.Stats, Def.Record->getLocation());
         };
         for (const NamespaceDef &Def : namespaces) {
-          Generator G(&Def, Out, Ctx, &Moc);
-          G.MetaData = Options.MetaData;
+          Generator G(&Def, ClassOut, Ctx, &Moc);
+          SetupGenerator(G, &Def);
           G.GenerateCode();
+          CheckSize(G.Stats, Def.Namespace->getLocation());
         };
 
+        if (Options.SharedStrings) {
+            if (!SharedStrings.Strings.empty())
+                Generator::GenerateStringData(Out, Out, SharedStrings, "qt_meta_stringdata_shared_" + FileIdentifier,
+                                              false, Options.ConstexprData);
+            Out << ClassCodeOS.str();
+        }
+
         llvm::StringRef footer =
                "QT_END_MOC_NAMESPACE\n"
                "#ifdef QT_WARNING_DISABLE_DEPRECATED\n"
@@ -237,10 +474,43 @@ struct MocNGASTConsumer : public MocASTConsumer {
         if (OS_TemplateHeader) {
             (*OS_TemplateHeader) << footer;
         }
+
+        if (&Out == &BufferOS)
+            WriteOutput(Options.Output, BufferOS.str());
+        if (OS_TemplateHeader == &TemplateBufferOS)
+            WriteOutput(Options.OutputTemplateHeader, TemplateBufferOS.str());
+    }
+
+    void WriteOutput(const std::string &Path, llvm::StringRef Content) {
+        if (!UpdateFile(Path, Content)) {
+            ci.getDiagnostics().Report(ci.getDiagnostics().getCustomDiagID(clang::DiagnosticsEngine::Error,
+                                                                           "unable to write '%0'")) << Path;
+        }
     }
 };
 
+// The options must be the same when building the preamble, or it cannot be loaded.
+static void SetupMocLangOptions(clang::CompilerInstance &CI) {
+    CI.getFrontendOpts().SkipFunctionBodies = true;
+    CI.getLangOpts().DelayedTemplateParsing = true;
+
+    //enable all the extension
+    CI.getLangOpts().MicrosoftExt = true;
+    CI.getLangOpts().DollarIdents = true;
+    CI.getLangOpts().CPlusPlus11 = true;
+#if CLANG_VERSION_MAJOR == 3 && CLANG_VERSION_MINOR <= 5
+    CI.getLangOpts().CPlusPlus1y = true;
+#else
+    CI.getLangOpts().CPlusPlus14 = true;
+#endif
+    CI.getLangOpts().GNUMode = true;
+}
+
 class MocAction : public clang::ASTFrontendAction {
+    const MocOptions &Options;
+    std::vector<std::string> *Dependencies;
+    std::vector<std::string> PrecompiledTags;
+    std::vector<std::string> *AbsentFiles;
 protected:
 #if CLANG_VERSION_MAJOR == 3 && CLANG_VERSION_MINOR <= 5
     clang::ASTConsumer *
@@ -249,39 +519,384 @@ protected:
 #endif
     CreateASTConsumer(clang::CompilerInstance &CI, llvm::StringRef InFile) override {
 
-        CI.getFrontendOpts().SkipFunctionBodies = true;
+        SetupMocLangOptions(CI);
         CI.getPreprocessor().enableIncrementalProcessing(true);
         CI.getPreprocessor().SetSuppressIncludeNotFoundError(true);
-        CI.getLangOpts().DelayedTemplateParsing = true;
 
-        //enable all the extension
-        CI.getLangOpts().MicrosoftExt = true;
-        CI.getLangOpts().DollarIdents = true;
-        CI.getLangOpts().CPlusPlus11 = true;
+        // The client is not owned when it is the one of the MocEnvironment
+        clang::DiagnosticsEngine &Diags = CI.getDiagnostics();
+        if (Diags.ownsClient())
+            Diags.setClient(new MocDiagConsumer(std::unique_ptr<clang::DiagnosticConsumer>(Diags.takeClient())));
+        else
+            Diags.setClient(new MocDiagConsumer(Diags.getClient()));
+
+        return maybe_unique(new MocNGASTConsumer(CI, InFile, Options, Dependencies, AbsentFiles, PrecompiledTags));
+    }
+
+public:
+    explicit MocAction(const MocOptions &Options, std::vector<std::string> *Dependencies = nullptr,
+                       std::vector<std::string> PrecompiledTags = {},
+                       std::vector<std::string> *AbsentFiles = nullptr)
+        : Options(Options), Dependencies(Dependencies), PrecompiledTags(std::move(PrecompiledTags)),
+          AbsentFiles(AbsentFiles) {}
+
+    // CHECK
+    virtual bool hasCodeCompletionSupport() const { return true; }
+};
+
+/* Build the precompiled header for the QtCore/qobject.h include which is forced on every header.
+ * MocPPCallbacks need to be there as well, so the macros from qobjectdefs-injected end up in it.
+ */
+class MocPCHAction : public clang::GeneratePCHAction {
+    std::string OutputFile;
+    std::vector<std::string> &Dependencies;
+    std::vector<std::string> &AbsentFiles;
+    std::vector<std::string> &TagNames;
+    std::vector<TagDef> Tags;
+
+    // Record the files that were read to build the precompiled header
+    struct DependencyCollector : clang::PPCallbacks {
+        clang::SourceManager &SM;
+        std::vector<std::string> &Dependencies;
+        DependencyCollector(clang::SourceManager &SM, std::vector<std::string> &Dependencies)
+            : SM(SM), Dependencies(Dependencies) {}
+        void FileChanged(clang::SourceLocation Loc, FileChangeReason Reason,
+                         clang::SrcMgr::CharacteristicKind, clang::FileID) override {
+            if (Reason != EnterFile)
+                return;
+            if (auto F = SM.getFileEntryForID(SM.getFileID(SM.getFileLoc(Loc))))
+                Dependencies.push_back(F->getName());
+        }
+    };
+
+protected:
 #if CLANG_VERSION_MAJOR == 3 && CLANG_VERSION_MINOR <= 5
-        CI.getLangOpts().CPlusPlus1y = true;
+    clang::ASTConsumer *
+#else
+    std::unique_ptr<clang::ASTConsumer>
+#endif
+    CreateASTConsumer(clang::CompilerInstance &CI, llvm::StringRef InFile) override {
+        SetupMocLangOptions(CI);
+        CI.getFrontendOpts().OutputFile = OutputFile;
+        // If it does not build, we just don't use it. The errors will be shown by the real run.
+        CI.getDiagnostics().setClient(new clang::IgnoringDiagConsumer);
+        auto &PP = CI.getPreprocessor();
+        auto PPCallbacks = new MocPPCallbacks(PP, Tags);
+        PPCallbacks->TagNames = &TagNames;
+        PPCallbacks->AbsentFiles = &AbsentFiles;
+        PP.addPPCallbacks(maybe_unique(PPCallbacks));
+        PP.addPPCallbacks(maybe_unique(new DependencyCollector(PP.getSourceManager(), Dependencies)));
+        return clang::GeneratePCHAction::CreateASTConsumer(CI, InFile);
+    }
+
+public:
+    MocPCHAction(std::string OutputFile, std::vector<std::string> &Dependencies,
+                 std::vector<std::string> &AbsentFiles, std::vector<std::string> &TagNames)
+        : OutputFile(std::move(OutputFile)), Dependencies(Dependencies), AbsentFiles(AbsentFiles),
+          TagNames(TagNames) {}
+};
+
+// Size and modification time of a file, to check that a cached result is still up to date.
+struct FileStamp {
+    std::string Path; // relative to the working directory of the environment, or absolute
+    uint64_t Size = 0;
+    int64_t MTime = 0; // in nanoseconds, so that a change within the same second is seen
+
+    bool read(const MocEnvironment &Env) {
+        llvm::sys::fs::file_status Status;
+        if (llvm::sys::fs::status(Env.absolute(Path), Status))
+            return false;
+        Size = Status.getSize();
+#if CLANG_VERSION_MAJOR == 3
+        auto Time = Status.getLastModificationTime();
+        MTime = Time.toEpochTime() * 1000000000 + Time.nanoseconds();
 #else
-        CI.getLangOpts().CPlusPlus14 = true;
+        MTime = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            Status.getLastModificationTime().time_since_epoch()).count();
 #endif
-        CI.getLangOpts().GNUMode = true;
+        return true;
+    }
+    bool isUpToDate(const MocEnvironment &Env) const {
+        FileStamp Current;
+        Current.Path = Path;
+        return Current.read(Env) && Current.Size == Size && Current.MTime == MTime;
+    }
+};
 
-        CI.getDiagnostics().setClient(new MocDiagConsumer(
-            std::unique_ptr<clang::DiagnosticConsumer>(CI.getDiagnostics().takeClient())));
+/* The inputs of a cached result: the files that were read, and the files that must still not
+ * exist (see AddAbsentIncludes).  They are saved one per line, as "<size> <mtime> <path>" and
+ * "! <path>".
+ */
+struct FileStamps {
+    std::vector<FileStamp> Files;
+    std::vector<std::string> AbsentFiles;
 
-        return maybe_unique(new MocNGASTConsumer(CI, InFile));
+    bool filesAreUpToDate(const MocEnvironment &Env) const {
+        return std::all_of(Files.begin(), Files.end(), [&](const FileStamp &F) { return F.isUpToDate(Env); });
+    }
+    bool absentFilesAreAbsent(const MocEnvironment &Env) const {
+        return std::none_of(AbsentFiles.begin(), AbsentFiles.end(), [&](const std::string &F) {
+            return llvm::sys::fs::exists(Env.absolute(F));
+        });
+    }
+    bool isUpToDate(const MocEnvironment &Env) const {
+        return absentFilesAreAbsent(Env) && filesAreUpToDate(Env);
+    }
+    void addAbsentFiles(const std::vector<std::string> &Paths) {
+        std::set<std::string> Seen(AbsentFiles.begin(), AbsentFiles.end());
+        for (const auto &P : Paths) {
+            if (Seen.insert(P).second)
+                AbsentFiles.push_back(P);
+        }
     }
+    void read(std::istream &In) {
+        std::string Line;
+        while (std::getline(In, Line)) {
+            if (llvm::StringRef(Line).startswith("! ")) {
+                AbsentFiles.push_back(Line.substr(2));
+                continue;
+            }
+            std::istringstream L(Line);
+            FileStamp F;
+            if (L >> F.Size >> F.MTime && L.get() == ' ' && std::getline(L, F.Path))
+                Files.push_back(F);
+        }
+    }
+    void write(llvm::raw_ostream &OS) const {
+        for (const auto &F : Files)
+            OS << F.Size << " " << F.MTime << " " << F.Path << "\n";
+        for (const auto &F : AbsentFiles)
+            OS << "! " << F << "\n";
+    }
+};
 
+// Find the version of Qt in the include paths. Returns an empty string if not found.
+static std::string FindQtVersion(const std::vector<std::string> &Argv, const MocEnvironment &Env)
+{
+    const llvm::StringRef Define = "#define QT_VERSION_STR";
+    for (size_t I = 0; I < Argv.size(); ++I) {
+        llvm::StringRef Arg = Argv[I];
+        llvm::StringRef Dir;
+        if (Arg == "-I" && I + 1 < Argv.size())
+            Dir = Argv[++I];
+        else if (Arg.startswith("-I"))
+            Dir = Arg.substr(2);
+        else
+            continue;
+        for (const char *Header : { "/QtCore/qglobal.h", "/qglobal.h" }) {
+            std::ifstream File(Env.absolute(Dir) + Header);
+            std::string Line;
+            while (std::getline(File, Line)) {
+                llvm::StringRef L = llvm::StringRef(Line).trim();
+                if (L.startswith(Define))
+                    return L.substr(Define.size()).trim().str();
+            }
+        }
+    }
+    return {};
+}
+
+/* Keep the precompiled QtCore/qobject.h for each set of arguments.
+ * Thread safe, so it can be shared by the workers.
+ * If Persistent, the precompiled headers stay in the directory and are reused by the next runs.
+ * For each key, <key>.deps contains the name of the precompiled header and the tags it defines
+ * (see MocPPCallbacks::TagNames) on the first line, followed by the files it was built from
+ * (see FileStamps).
+ */
+class PreambleCache {
 public:
-    // CHECK
-    virtual bool hasCodeCompletionSupport() const { return true; }
+    // A precompiled header file. If it is not Persistent, the file is removed once the cache and
+    // the jobs using it are done with it, so a stale preamble is never removed under a running job.
+    struct PCHFile {
+        std::string Path;
+        bool Remove = false;
+        ~PCHFile() {
+            if (Remove)
+                llvm::sys::fs::remove(Path);
+        }
+    };
+    typedef std::shared_ptr<const PCHFile> PCHHandle;
+
+private:
+    struct Preamble {
+        bool Built = false;
+        PCHHandle PCH; // null if it could not be built
+        std::vector<std::string> Tags;
+        FileStamps Inputs;
+    };
+
+    // Each key has its own lock, so building one preamble does not block the jobs using another.
+    struct Entry {
+        std::mutex Mutex;
+        Preamble P;
+    };
+
+    std::string Directory;
+    bool Persistent;
+    std::mutex Mutex; // for Preambles
+    std::map<std::string, Entry> Preambles;
+
+    bool load(llvm::StringRef Key, const MocEnvironment &Env, Preamble &P);
+    void save(llvm::StringRef Key, const Preamble &P);
+
+public:
+    PreambleCache(std::string Directory, bool Persistent)
+        : Directory(std::move(Directory)), Persistent(Persistent) {}
+
+    // Return the precompiled header to use with these arguments (which do not contain the input
+    // file), building it if needed.  Return null if there is none. The handle must be kept while
+    // the file is used.
+    // The tags it defines are returned in Tags, the files it was built from are added to
+    // Dependencies, and the files which must not appear to AbsentFiles.
+    PCHHandle get(const std::vector<std::string> &Argv, const MocEnvironment &Env,
+                    clang::FileManager *FM, std::vector<std::string> &Tags,
+                    std::vector<std::string> *Dependencies = nullptr,
+                    std::vector<std::string> *AbsentFiles = nullptr);
 };
 
-static void showVersion(bool /*Long*/) {
-    std::cerr << "moc-ng version " MOCNG_VERSION_STR " by Woboq [https://woboq.com]" << std::endl;
+bool PreambleCache::load(llvm::StringRef Key, const MocEnvironment &Env, Preamble &P)
+{
+    std::ifstream Deps(Directory + "/" + Key.str() + ".deps");
+    std::string Line;
+    if (!std::getline(Deps, Line))
+        return false;
+    std::istringstream Header(Line);
+    std::string PCHName, Tag;
+    if (!(Header >> PCHName))
+        return false;
+    while (Header >> Tag)
+        P.Tags.push_back(Tag);
+    P.Inputs.read(Deps);
+    auto PCH = std::make_shared<PCHFile>();
+    PCH->Path = Directory + "/" + PCHName;
+    P.PCH = PCH;
+    P.Built = true;
+    return llvm::sys::fs::exists(PCH->Path) && P.Inputs.isUpToDate(Env);
+}
+
+void PreambleCache::save(llvm::StringRef Key, const Preamble &P)
+{
+    // Write to a temporary file and rename, so that concurrent moc processes never see a
+    // partially written file.
+    llvm::SmallString<128> TempFile;
+    int FD;
+    if (llvm::sys::fs::createUniqueFile(llvm::Twine(Directory) + "/" + Key + "-%%%%%%%%.deps.tmp", FD, TempFile))
+        return;
+    {
+        llvm::raw_fd_ostream OS(FD, /*shouldClose=*/true);
+        OS << llvm::sys::path::filename(P.PCH->Path);
+        for (const auto &T : P.Tags)
+            OS << " " << T;
+        OS << "\n";
+        P.Inputs.write(OS);
+    }
+    if (llvm::sys::fs::rename(TempFile, llvm::Twine(Directory) + "/" + Key + ".deps"))
+        llvm::sys::fs::remove(TempFile);
 }
 
-static void showHelp() {
-    std::cerr << "Usage moc: [options] <header-file>\n"
+PreambleCache::PCHHandle PreambleCache::get(const std::vector<std::string> &Argv, const MocEnvironment &Env,
+                               clang::FileManager *FM, std::vector<std::string> &Tags,
+                               std::vector<std::string> *Dependencies,
+                               std::vector<std::string> *AbsentFiles)
+{
+    // The arguments contain the include paths and the defines, and the working directory against
+    // which the relative paths are resolved.
+    llvm::MD5 Hash;
+    for (auto It = Argv.begin() + 1; It != Argv.end(); ++It) {
+        Hash.update(llvm::StringRef(It->c_str(), It->size() + 1));
+    }
+    Hash.update(FindQtVersion(Argv, Env));
+    Hash.update(MOCNG_VERSION_STR);
+    Hash.update(CLANG_VERSION_STRING);
+    llvm::MD5::MD5Result Result;
+    Hash.final(Result);
+    llvm::SmallString<32> Key;
+    llvm::MD5::stringifyResult(Result, Key);
+
+    auto Found = [&](const Preamble &P) {
+        if (Dependencies) {
+            for (const auto &D : P.Inputs.Files)
+                Dependencies->push_back(D.Path);
+        }
+        if (AbsentFiles)
+            AbsentFiles->insert(AbsentFiles->end(), P.Inputs.AbsentFiles.begin(), P.Inputs.AbsentFiles.end());
+        Tags = P.Tags;
+        return P.PCH;
+    };
+
+    Entry *E;
+    {
+        std::lock_guard<std::mutex> Lock(Mutex);
+        E = &Preambles[Key.str()];
+    }
+    std::lock_guard<std::mutex> Lock(E->Mutex);
+    Preamble &P = E->P;
+    if (P.Built && (!P.PCH || P.Inputs.isUpToDate(Env)))
+        return Found(P);
+
+    if (!P.Built && Persistent && load(Key, Env, P))
+        return Found(P);
+    // A stale file is removed when the last job using it releases it. (Never in the persistent
+    // cache, where it might still be used by another moc process.)
+    P = Preamble();
+    P.Built = true;
+
+    // A new name each time, as the FileManager may remember the previous file.
+    llvm::SmallString<128> Stub;
+    if (llvm::sys::fs::createUniqueFile(llvm::Twine(Directory) + "/" + Key + "-%%%%%%%%.h", Stub))
+        return {};
+    std::string PCHPath = (Stub.substr(0, Stub.size() - 2) + ".pch").str();
+
+    std::vector<std::string> Args = Argv;
+    Args.push_back("-include");
+    Args.push_back("QtCore/qobject.h");
+    Args.push_back("-x");
+    Args.push_back("c++-header");
+    Args.push_back(std::string(Stub.str()));
+
+    std::vector<std::string> Inputs;
+    std::vector<std::string> Absent;
+    std::vector<std::string> TagNames;
+    clang::tooling::ToolInvocation Inv(Args, new MocPCHAction(PCHPath, Inputs, Absent, TagNames), FM);
+    clang::IgnoringDiagConsumer IgnoreDiags;
+    Inv.setDiagnosticConsumer(&IgnoreDiags);
+    const EmbeddedFile *f = EmbeddedFiles;
+    while (f->filename) {
+        Inv.mapVirtualFile(f->filename, {f->content , f->size } );
+        f++;
+    }
+    bool Success = Inv.run() && llvm::sys::fs::exists(PCHPath);
+    llvm::sys::fs::remove(Stub);
+    if (!Success) {
+        llvm::sys::fs::remove(PCHPath);
+        return {};
+    }
+
+    for (const std::string &Path : Inputs) {
+        FileStamp D;
+        D.Path = Env.absolute(Path);
+        // The embedded files are not on the disk.
+        if (D.read(Env))
+            P.Inputs.Files.push_back(D);
+    }
+    P.Inputs.addAbsentFiles(Absent);
+    auto PCH = std::make_shared<PCHFile>();
+    PCH->Path = PCHPath;
+    PCH->Remove = !Persistent;
+    P.PCH = PCH;
+    P.Tags = std::move(TagNames);
+    if (Persistent)
+        save(Key, P);
+    return Found(P);
+}
+
+static void showVersion(llvm::raw_ostream &Err, bool /*Long*/) {
+    Err << "moc-ng version " MOCNG_VERSION_STR " by Woboq [https://woboq.com]\n";
+}
+
+static void showHelp(llvm::raw_ostream &Err) {
+    Err << "Usage moc: [options] <header-file>\n"
+              "          [options] --batch <header-file>=<output-file>...\n"
               "  -o<file>           write output to file rather than stdout\n"
               "  -I<dir>            add dir to the include path for header files\n"
               "  -E                 preprocess only; do not generate meta object code\n"
@@ -289,6 +904,9 @@ static void showHelp() {
               "  -U<macro>          undefine macro\n"
               "  -M<key=valye>      add key/value pair to plugin meta data\n"
               "  -i                 do not generate an #include statement\n"
+              "  -MD                write the files read by moc in <output-file>.d, in the Makefile format\n"
+              "  -MF <file>         write the dependencies in file instead\n"
+              "  -MT <target>       the target of the rule in the depfile, instead of the output file\n"
 //               "  -p<path>           path prefix for included file\n"
 //               "  -f[<file>]         force #include, optional file name\n"
 //               "  -nn                do not display notes\n"
@@ -296,6 +914,29 @@ static void showHelp() {
 //               "  @<file>            read additional options from file\n"
               "  -v                 display version of moc-ng\n"
               "  -include <file>    Adds an implicit #include into the predefines buffer which is read before the source file is preprocessed\n"
+              "  --batch            process several headers in one run. Each input is given as <header-file>=<output-file>\n"
+              "  --batch-file <file> read the batch jobs from file, one '<header-file> <output-file> [<template-header-output>]' per line\n"
+              "  -j <N>             process the batch jobs with N threads (0 for the number of cores)\n"
+              "  --timings          print the time spent on each header\n"
+              "  --metacast-hash    generate a qt_metacast which switches on a hash of the class name\n"
+              "  --metatype-table   register the meta types of the method arguments with a table instead of a switch\n"
+              "  --member-table     read and write the trivially copyable MEMBER properties of the standard\n"
+              "                     layout classes (gadgets) through a table of offsets\n"
+              "  --shared-strings   use the same string data for all the classes of a file (except templates)\n"
+              "  --constexpr-data   let the compiler compute the offsets of the strings and check the meta data\n"
+              "  --shared-extradata use one deduplicated table of related meta objects for all the classes of a file\n"
+              "  --prescan          do not parse the headers which do not contain Q_OBJECT, Q_GADGET or\n"
+              "                     Q_NAMESPACE (misses the classes which use them through other macros)\n"
+              "  --write-if-changed do not touch the output files if their content did not change\n"
+              "  --cache-dir=<dir>  reuse the output of a previous run when the header and the files it\n"
+              "                     includes did not change\n"
+              "  --size-report=<file> write the size of the meta data and the number of cases in the\n"
+              "                     metacall functions of each class to file, in JSON\n"
+              "  --size-budget=<n>  warn about the classes whose meta data takes more than n bytes\n"
+              "  --pch-cache=<dir>  keep the precompiled QtCore headers in dir and reuse them in the next runs\n"
+              "  --server <socket>  run as a server: keep the QtCore headers precompiled and process the\n"
+              "                     command lines forwarded by the moc processes started with MOCNG_SERVER=<socket>.\n"
+              "                     The other options are added to each command line (e.g. --pch-cache)\n"
 
 /* undocumented options
               "  -W<warnings>       Enable the specified warning\n"
@@ -305,20 +946,370 @@ static void showHelp() {
 
 
 
-              << std::endl;
+              << "\n";
 
 
-    showVersion(false);
+    showVersion(Err, false);
 }
 
+// One header to process, and where to write the result.
+struct MocJob {
+    std::string InputFile;
+    std::string Output;
+    std::string OutputTemplateHeader;
+};
 
-int main(int argc, const char **argv)
+// Parse a batch file: one job per line, the input followed by the output(s), separated by spaces.
+// Empty lines and lines starting with '#' are ignored.
+static bool ReadBatchFile(llvm::StringRef FileName, std::vector<MocJob> &Jobs, const MocEnvironment &Env) {
+    std::ifstream File(Env.absolute(FileName));
+    if (!File) {
+        Env.Err << "moc-ng: Cannot open batch file '" << FileName << "'\n";
+        return false;
+    }
+    std::string Line;
+    int LineNumber = 0;
+    while (std::getline(File, Line)) {
+        LineNumber++;
+        std::istringstream Fields(Line);
+        MocJob Job;
+        if (!(Fields >> Job.InputFile) || Job.InputFile[0] == '#')
+            continue;
+        if (!(Fields >> Job.Output)) {
+            Env.Err << FileName << ":" << LineNumber << ": missing output file for '"
+                    << Job.InputFile << "'\n";
+            return false;
+        }
+        Fields >> Job.OutputTemplateHeader;
+        Jobs.push_back(std::move(Job));
+    }
+    return true;
+}
+
+/* The output cache (--cache-dir) is looked up without running the preprocessor, in two steps:
+ *  - <key>.deps, where the key hashes the arguments, the options and the input file name, contains
+ *    the content key on the first line, followed by the FileStamps of the last time this header was
+ *    processed: the files that were read (the header itself, its includes, and the inputs of the
+ *    precompiled preamble), and the files that were looked for but did not exist (the includes that
+ *    were not found, and the ones that would shadow the includes that were);
+ *  - <content key>.moc, where the content key also hashes the content of all these files, contains
+ *    the output, and <content key>.moc.template the template header.
+ * If one of the absent files exists, the entry is not used. If the files still have the same
+ * stamps, the content key is taken from the manifest; otherwise it is computed again from their
+ * content, so that touching a file does not invalidate the entry.
+ */
+static std::string ComputeCacheKey(const std::vector<std::string> &Argv, llvm::StringRef InputFile,
+                                   const MocOptions &Options)
+{
+    llvm::MD5 Hash;
+    Hash.update(MOCNG_VERSION_STR);
+    for (auto It = Argv.begin() + 1; It != Argv.end(); ++It)
+        Hash.update(llvm::StringRef(It->c_str(), It->size() + 1));
+    Hash.update(InputFile);
+    Options.hash(Hash);
+
+    llvm::MD5::MD5Result Result;
+    Hash.final(Result);
+    llvm::SmallString<32> Key;
+    llvm::MD5::stringifyResult(Result, Key);
+    return Key.str().str();
+}
+
+// Returns the key of the cached output for these dependencies, or an empty string if one of them
+// cannot be read.  Their stamps are added to Stamps.
+static std::string ComputeContentKey(llvm::StringRef Key, const std::vector<std::string> &Dependencies,
+                                     const MocEnvironment &Env, std::vector<FileStamp> &Stamps)
+{
+    llvm::MD5 Hash;
+    Hash.update(Key);
+    std::string Content;
+    for (const auto &D : Dependencies) {
+        // Stamp before reading, so a change made in between is seen by the next lookup.
+        FileStamp Stamp;
+        Stamp.Path = D;
+        if (!Stamp.read(Env) || !ReadFile(Env.absolute(D), Content))
+            return {};
+        Stamps.push_back(Stamp);
+        Hash.update(llvm::StringRef(D.c_str(), D.size() + 1));
+        Hash.update(std::to_string(Content.size()));
+        Hash.update(Content);
+    }
+
+    llvm::MD5::MD5Result Result;
+    Hash.final(Result);
+    llvm::SmallString<32> ContentKey;
+    llvm::MD5::stringifyResult(Result, ContentKey);
+    return ContentKey.str().str();
+}
+
+static bool WriteManifest(const std::string &Path, llvm::StringRef ContentKey, const FileStamps &Inputs)
+{
+    std::string Content;
+    llvm::raw_string_ostream OS(Content);
+    OS << ContentKey << "\n";
+    Inputs.write(OS);
+    return WriteFileAtomically(Path, OS.str());
+}
+
+static bool CopyFileAtomically(const std::string &From, const std::string &To, bool OnlyIfChanged = false)
+{
+    std::string Content;
+    if (!ReadFile(From, Content))
+        return false;
+    return OnlyIfChanged ? UpdateFile(To, Content) : WriteFileAtomically(To, Content);
+}
+
+// Write a Makefile style depfile: "<output>: <dependencies>"
+static bool WriteDepFile(const MocOptions &Options, const std::vector<std::string> &Dependencies)
+{
+    std::string Content;
+    llvm::raw_string_ostream OS(Content);
+    auto Escape = [&](llvm::StringRef Path) {
+        for (char C : Path) {
+            if (C == ' ' || C == '#')
+                OS << '\\';
+            else if (C == '$')
+                OS << '$';
+            OS << C;
+        }
+    };
+    Escape(Options.DepFileTarget);
+    OS << ":";
+    std::set<std::string> Seen;
+    for (const auto &D : Dependencies) {
+        if (!Seen.insert(D).second)
+            continue;
+        OS << " \\\n  ";
+        Escape(D);
+    }
+    OS << "\n";
+    if (!WriteFileAtomically(Options.DepFile, OS.str())) {
+        Options.Env->Err << "moc-ng: cannot write " << Options.DepFile << "\n";
+        return false;
+    }
+    return true;
+}
+
+// Quickly check with the raw lexer if the header uses one of the macros that moc is looking for,
+// so the compiler does not need to be started for the headers that have none.
+// Content must be null terminated.
+static bool MightContainQtMacros(llvm::StringRef Content)
+{
+    clang::LangOptions LangOpts;
+    LangOpts.CPlusPlus = true;
+    LangOpts.CPlusPlus11 = true;
+    clang::Lexer Lex(clang::SourceLocation(), LangOpts, Content.begin(), Content.begin(), Content.end());
+    clang::Token Tok;
+    do {
+        Lex.LexFromRawLexer(Tok);
+        if (Tok.is(clang::tok::raw_identifier)) {
+#if CLANG_VERSION_MAJOR == 3 && CLANG_VERSION_MINOR <= 4
+            llvm::StringRef Name(Tok.getRawIdentifierData(), Tok.getLength());
+#else
+            llvm::StringRef Name = Tok.getRawIdentifier();
+#endif
+            if (Name == "Q_OBJECT" || Name.startswith("Q_GADGET") || Name.startswith("Q_NAMESPACE"))
+                return true;
+        }
+    } while (Tok.isNot(clang::tok::eof));
+    return false;
+}
+
+static void WriteJsonString(llvm::raw_ostream &OS, llvm::StringRef Str)
+{
+    OS << '"';
+    for (unsigned char C : Str) {
+        if (C == '"' || C == '\\')
+            OS << '\\' << C;
+        else if (C < 0x20)
+            OS << llvm::format("\\u%04x", C);
+        else
+            OS << C;
+    }
+    OS << '"';
+}
+
+bool SizeReport::write(const std::string &FileName)
+{
+    std::string Content;
+    llvm::raw_string_ostream OS(Content);
+    OS << "[";
+    for (const auto &C : Classes) {
+        OS << (&C == &Classes.front() ? "\n" : ",\n") << "  { \"file\": ";
+        WriteJsonString(OS, C.first);
+        OS << ", \"class\": ";
+        WriteJsonString(OS, C.second.ClassName);
+        OS << ", \"dataBytes\": " << C.second.DataBytes
+           << ", \"stringCount\": " << C.second.StringCount
+           << ", \"stringBytes\": " << C.second.StringBytes
+           << ", \"staticMetaCallCases\": " << C.second.StaticMetaCallCases
+           << ", \"metaCallCases\": " << C.second.MetaCallCases << " }";
+    }
+    OS << "\n]\n";
+    return WriteFileAtomically(FileName, OS.str());
+}
+
+// Run moc on one file.  Argv contains the common arguments, without the input file.
+static bool RunMocJob(std::vector<std::string> Argv, llvm::StringRef InputFile,
+                      const MocOptions &Options, clang::FileManager *FM, PreambleCache *Preambles)
+{
+    std::vector<std::string> Dependencies;
+    std::vector<std::string> *DepsPtr = Options.DepFile.empty() ? nullptr : &Dependencies;
+
+    std::string Content;
+    if (Options.Prescan && !InputFile.empty() && !InputFile.endswith("qnamespace.h")
+            && ReadFile(Options.Env->absolute(InputFile), Content) && !MightContainQtMacros(Content)) {
+        // Same warning as MocNGASTConsumer, without starting the compiler
+        clang::TextDiagnosticPrinter DiagPrinter(Options.Env->Err, new clang::DiagnosticOptions);
+        clang::DiagnosticsEngine Diags(new clang::DiagnosticIDs, new clang::DiagnosticOptions, &DiagPrinter, false);
+        clang::SourceManager SM(Diags, *FM);
+        Diags.setSourceManager(&SM);
+        llvm::MemoryBuffer *Buf = maybe_unique(llvm::MemoryBuffer::getMemBuffer(Content, InputFile));
+        clang::FileID FID = CreateFileIDForMemBuffer(SM, Buf, {});
+        clang::LangOptions LangOpts;
+        DiagPrinter.BeginSourceFile(LangOpts, nullptr);
+        Diags.Report(SM.getLocForStartOfFile(FID),
+                     Diags.getCustomDiagID(clang::DiagnosticsEngine::Warning,
+                                           "No relevant classes found. No output generated"));
+        DiagPrinter.EndSourceFile();
+        //actually still create an empty file like moc does.
+        if (Options.Output != "-") {
+            bool Written = Options.WriteIfChanged ? UpdateFile(Options.Output, "")
+                                                  : WriteFileAtomically(Options.Output, "");
+            if (!Written) {
+                Options.Env->Err << "moc-ng: cannot write " << Options.Output << "\n";
+                return false;
+            }
+        }
+        Dependencies.push_back(InputFile.str());
+        return Options.DepFile.empty() || WriteDepFile(Options, Dependencies);
+    }
+
+    // The sizes are only known when the code is generated, so do not use the cache for the report.
+    std::string CacheKey;
+    std::vector<std::string> AbsentFiles;
+    std::vector<std::string> *AbsentPtr = nullptr;
+    if (!Options.CacheDir.empty() && !InputFile.empty() && Options.Output != "-" && !Options.Sizes) {
+        // The key does not depend on the preamble: its content is covered by its inputs, which are
+        // part of the dependencies.
+        CacheKey = ComputeCacheKey(Argv, InputFile, Options);
+        std::string ManifestFile = Options.CacheDir + "/" + CacheKey + ".deps";
+        std::ifstream Manifest(ManifestFile);
+        std::string ContentKey;
+        FileStamps Cached;
+        if (std::getline(Manifest, ContentKey)) {
+            Cached.read(Manifest);
+            // The input file is always there, unless the manifest is from an older version
+            if (Cached.Files.empty())
+                ContentKey.clear();
+            std::vector<std::string> CachedDeps;
+            for (const auto &F : Cached.Files)
+                CachedDeps.push_back(F.Path);
+            if (!Cached.absentFilesAreAbsent(*Options.Env)) {
+                ContentKey.clear();
+            } else if (!Cached.filesAreUpToDate(*Options.Env)) {
+                FileStamps Current;
+                Current.AbsentFiles = Cached.AbsentFiles;
+                std::string CurrentKey = ComputeContentKey(CacheKey, CachedDeps, *Options.Env, Current.Files);
+                // Only touched: keep the new stamps so the files are not read again next time
+                if (!CurrentKey.empty() && CurrentKey == ContentKey)
+                    WriteManifest(ManifestFile, ContentKey, Current);
+                ContentKey = CurrentKey;
+            }
+            std::string CacheFile = Options.CacheDir + "/" + ContentKey + ".moc";
+            if (!ContentKey.empty() && llvm::sys::fs::exists(CacheFile)) {
+                bool Restored = CopyFileAtomically(CacheFile, Options.Output, Options.WriteIfChanged);
+                if (Restored && !Options.OutputTemplateHeader.empty()
+                        && llvm::sys::fs::exists(CacheFile + ".template"))
+                    Restored = CopyFileAtomically(CacheFile + ".template", Options.OutputTemplateHeader,
+                                                  Options.WriteIfChanged);
+                if (Restored)
+                    return Options.DepFile.empty() || WriteDepFile(Options, CachedDeps);
+            }
+        }
+        // The dependencies are needed to store the output
+        DepsPtr = &Dependencies;
+        AbsentPtr = &AbsentFiles;
+    }
+
+    std::vector<std::string> PrecompiledTags;
+    PreambleCache::PCHHandle PCH; // keeps the file until the job is done
+    if (!InputFile.endswith("qobject.h") && !InputFile.endswith("qnamespace.h")) {
+        // QObject should always be included
+        // But not not for qobject.h (or we would not detect the main file correctly) or
+        // qnamespace.h (that would break the Q_MOC_RUN workaround from MocPPCallbacks::EnterMainFile)
+        PCH = Preambles ? Preambles->get(Argv, *Options.Env, FM, PrecompiledTags, DepsPtr, AbsentPtr) : nullptr;
+        if (PCH) {
+            Argv.push_back("-include-pch");
+            Argv.push_back(PCH->Path);
+        } else {
+            Argv.push_back("-include");
+            Argv.push_back("QtCore/qobject.h");
+        }
+    }
+    Argv.push_back(InputFile.empty() ? "-" : InputFile.str());
+
+    clang::tooling::ToolInvocation Inv(Argv, new MocAction(Options, DepsPtr, std::move(PrecompiledTags), AbsentPtr), FM);
+    clang::TextDiagnosticPrinter DiagPrinter(Options.Env->Err, new clang::DiagnosticOptions);
+    Inv.setDiagnosticConsumer(&DiagPrinter);
+
+    const EmbeddedFile *f = EmbeddedFiles;
+    while (f->filename) {
+        Inv.mapVirtualFile(f->filename, {f->content , f->size } );
+        f++;
+    }
+
+    if (!Inv.run())
+        return false;
+
+    if (!CacheKey.empty()) {
+        std::vector<std::string> CacheDeps;
+        std::set<std::string> Seen;
+        if (std::find(Dependencies.begin(), Dependencies.end(), InputFile) == Dependencies.end())
+            Dependencies.insert(Dependencies.begin(), InputFile.str());
+        for (const auto &D : Dependencies) {
+            if (Seen.insert(D).second)
+                CacheDeps.push_back(D);
+        }
+        FileStamps Inputs;
+        Inputs.addAbsentFiles(AbsentFiles);
+        std::string ContentKey = ComputeContentKey(CacheKey, CacheDeps, *Options.Env, Inputs.Files);
+        if (!ContentKey.empty()) {
+            // Store the template header first, so the cache entry is complete once the output exists.
+            std::string CacheFile = Options.CacheDir + "/" + ContentKey + ".moc";
+            if (!Options.OutputTemplateHeader.empty() && llvm::sys::fs::exists(Options.OutputTemplateHeader))
+                CopyFileAtomically(Options.OutputTemplateHeader, CacheFile + ".template");
+            if (CopyFileAtomically(Options.Output, CacheFile))
+                WriteManifest(Options.CacheDir + "/" + CacheKey + ".deps", ContentKey, Inputs);
+        }
+    }
+    return Options.DepFile.empty() || WriteDepFile(Options, Dependencies);
+}
+
+
+static int RunMoc(int argc, const char **argv, const MocEnvironment &Env, PreambleCache *Preambles)
 {
   bool PreprocessorOnly = false;
+  bool Batch = false;
+  bool ShowTimings = false;
+  unsigned NumThreads = 1;
+  std::string PCHCacheDir;
+  std::string ServerSocket;
+  int ServerArgBegin = 0, ServerArgEnd = 0; // the --server option within argv
+  std::string SizeReportFile;
+  SizeReport Sizes;
+  bool GenerateDepFile = false;
+  std::string DepFile;
+  std::string DepTarget;
+  MocOptions Options;
+  Options.Env = &Env;
+  std::vector<MocJob> Jobs;
   std::vector<std::string> Argv;
   Argv.push_back(argv[0]);
   Argv.push_back("-x");  // Type need to go first
   Argv.push_back("c++");
+  Argv.push_back("-working-directory");
+  Argv.push_back(Env.WorkingDir);
   Argv.push_back("-fPIE");
   Argv.push_back("-fPIC");
   Argv.push_back("-Wno-microsoft"); // get rid of a warning in qtextdocument.h
@@ -330,8 +1321,7 @@ int main(int argc, const char **argv)
 #endif
 
   bool NextArgNotInput = false;
-  bool HasInput = false;
-  llvm::StringRef InputFile;
+  std::vector<llvm::StringRef> Inputs;
 
   for (int I = 1 ; I < argc; ++I) {
     if (argv[I][0] == '-') {
@@ -339,15 +1329,19 @@ int main(int argc, const char **argv)
         switch (argv[I][1]) {
             case 'h':
             case '?':
-                showHelp();
+                showHelp(Env.Err);
                 return EXIT_SUCCESS;
             case 'v':
-                showVersion(true);
+                showVersion(Env.Err, true);
                 return EXIT_SUCCESS;
-            case 'o':
-                if (argv[I][2]) Options.addOutput(&argv[I][2]);
-                else if ((++I) < argc) Options.addOutput(argv[I]);
+            case 'o': {
+                llvm::StringRef Out;
+                if (argv[I][2]) Out = &argv[I][2];
+                else if ((++I) < argc) Out = argv[I];
+                if (!Out.empty() && !Options.addOutput(Out))
+                    Env.Err << "moc-ng: Too many output file specified\n";
                 continue;
+            }
             case 'i':
                 if (argv[I] == llvm::StringRef("-i")) {
                     Options.NoInclude = true;
@@ -358,12 +1352,29 @@ int main(int argc, const char **argv)
                 }
                 goto invalidArg;
             case 'M': {
+                if (argv[I] == llvm::StringRef("-MD")) {
+                    GenerateDepFile = true;
+                    continue;
+                }
+                if (argv[I] == llvm::StringRef("-MF")) {
+                    if (I + 1 >= argc)
+                        goto invalidArg;
+                    DepFile = argv[++I];
+                    GenerateDepFile = true;
+                    continue;
+                }
+                if (argv[I] == llvm::StringRef("-MT")) {
+                    if (I + 1 >= argc)
+                        goto invalidArg;
+                    DepTarget = argv[++I];
+                    continue;
+                }
                 llvm::StringRef Arg;
                 if (argv[I][2]) Arg = &argv[I][2];
                 else if ((++I) < argc) Arg = argv[I];
                 size_t Eq = Arg.find('=');
                 if (Eq == llvm::StringRef::npos) {
-                    std::cerr << "moc-ng: missing key or value for option '-M'" << std::endl;
+                    Env.Err << "moc-ng: missing key or value for option '-M'\n";
                     return EXIT_FAILURE;
                 }
                 Options.MetaData.push_back({Arg.substr(0, Eq), Arg.substr(Eq+1)});
@@ -372,6 +1383,16 @@ int main(int argc, const char **argv)
             case 'E':
                 PreprocessorOnly = true;
                 break;
+            case 'j': {
+                llvm::StringRef Arg;
+                if (argv[I][2]) Arg = &argv[I][2];
+                else if ((++I) < argc) Arg = argv[I];
+                if (Arg.getAsInteger(10, NumThreads)) {
+                    Env.Err << "moc-ng: invalid number of jobs for option '-j'\n";
+                    return EXIT_FAILURE;
+                }
+                continue;
+            }
             case 'I':
             case 'U':
             case 'D':
@@ -410,29 +1431,214 @@ int main(int argc, const char **argv)
                     // MSVC flavor not yet implemented
                     continue;
                 }
+                if (llvm::StringRef(argv[I]) == "--timings") {
+                    ShowTimings = true;
+                    continue;
+                }
+                if (llvm::StringRef(argv[I]) == "--metacast-hash") {
+                    Options.HashedMetaCast = true;
+                    continue;
+                }
+                if (llvm::StringRef(argv[I]) == "--metatype-table") {
+                    Options.TableRegisterMetaTypes = true;
+                    continue;
+                }
+                if (llvm::StringRef(argv[I]) == "--member-table") {
+                    Options.MemberPropertyTable = true;
+                    continue;
+                }
+                if (llvm::StringRef(argv[I]) == "--shared-strings") {
+                    Options.SharedStrings = true;
+                    continue;
+                }
+                if (llvm::StringRef(argv[I]) == "--constexpr-data") {
+                    Options.ConstexprData = true;
+                    continue;
+                }
+                if (llvm::StringRef(argv[I]) == "--shared-extradata") {
+                    Options.SharedExtraData = true;
+                    continue;
+                }
+                if (llvm::StringRef(argv[I]) == "--prescan") {
+                    Options.Prescan = true;
+                    continue;
+                }
+                if (llvm::StringRef(argv[I]) == "--write-if-changed") {
+                    Options.WriteIfChanged = true;
+                    continue;
+                }
+                if (llvm::StringRef(argv[I]).startswith("--cache-dir")) {
+                    if (llvm::StringRef(argv[I]).startswith("--cache-dir=")) {
+                        Options.CacheDir = llvm::StringRef(argv[I]).substr(llvm::StringRef("--cache-dir=").size()).str();
+                    } else if (llvm::StringRef(argv[I]) == "--cache-dir" && I + 1 < argc) {
+                        Options.CacheDir = argv[++I];
+                    } else {
+                        goto invalidArg;
+                    }
+                    continue;
+                }
+                if (llvm::StringRef(argv[I]).startswith("--size-report")) {
+                    if (llvm::StringRef(argv[I]).startswith("--size-report=")) {
+                        SizeReportFile = llvm::StringRef(argv[I]).substr(llvm::StringRef("--size-report=").size()).str();
+                    } else if (llvm::StringRef(argv[I]) == "--size-report" && I + 1 < argc) {
+                        SizeReportFile = argv[++I];
+                    } else {
+                        goto invalidArg;
+                    }
+                    continue;
+                }
+                if (llvm::StringRef(argv[I]).startswith("--size-budget")) {
+                    llvm::StringRef Budget;
+                    if (llvm::StringRef(argv[I]).startswith("--size-budget=")) {
+                        Budget = llvm::StringRef(argv[I]).substr(llvm::StringRef("--size-budget=").size());
+                    } else if (llvm::StringRef(argv[I]) == "--size-budget" && I + 1 < argc) {
+                        Budget = argv[++I];
+                    }
+                    if (Budget.getAsInteger(10, Options.SizeBudget))
+                        goto invalidArg;
+                    continue;
+                }
+                if (llvm::StringRef(argv[I]).startswith("--pch-cache")) {
+                    if (llvm::StringRef(argv[I]).startswith("--pch-cache=")) {
+                        PCHCacheDir = llvm::StringRef(argv[I]).substr(llvm::StringRef("--pch-cache=").size()).str();
+                    } else if (llvm::StringRef(argv[I]) == "--pch-cache" && I + 1 < argc) {
+                        PCHCacheDir = argv[++I];
+                    } else {
+                        goto invalidArg;
+                    }
+                    continue;
+                }
+                if (llvm::StringRef(argv[I]).startswith("--server")) {
+                    ServerArgBegin = I;
+                    if (llvm::StringRef(argv[I]).startswith("--server=")) {
+                        ServerSocket = llvm::StringRef(argv[I]).substr(llvm::StringRef("--server=").size()).str();
+                    } else if (llvm::StringRef(argv[I]) == "--server" && I + 1 < argc) {
+                        ServerSocket = argv[++I];
+                    } else {
+                        goto invalidArg;
+                    }
+                    ServerArgEnd = I + 1;
+                    continue;
+                }
+                if (llvm::StringRef(argv[I]) == "--batch") {
+                    Batch = true;
+                    continue;
+                }
+                if (llvm::StringRef(argv[I]).startswith("--batch-file")) {
+                    llvm::StringRef File;
+                    if (llvm::StringRef(argv[I]).startswith("--batch-file=")) {
+                        File = llvm::StringRef(argv[I]).substr(llvm::StringRef("--batch-file=").size());
+                    } else if (llvm::StringRef(argv[I]) == "--batch-file" && I + 1 < argc) {
+                        File = llvm::StringRef(argv[++I]);
+                    } else {
+                        goto invalidArg;
+                    }
+                    if (!ReadBatchFile(File, Jobs, Env))
+                        return EXIT_FAILURE;
+                    Batch = true;
+                    continue;
+                }
                 LLVM_FALLTHROUGH;
             default:
 invalidArg:
-                std::cerr << "moc-ng: Invalid argument '" << argv[I] << "'" << std::endl;
-                showHelp();
+                Env.Err << "moc-ng: Invalid argument '" << argv[I] << "'\n";
+                showHelp(Env.Err);
                 return EXIT_FAILURE;
         }
     } else if (!NextArgNotInput) {
-        if (HasInput) {
-            std::cerr << "error: Too many input files specified" << std::endl;
-            return EXIT_FAILURE;
-        }
-        HasInput = true;
-        InputFile = argv[I];
+        Inputs.push_back(argv[I]);
+        continue;
     }
     Argv.push_back(argv[I]);
   }
 
-  if (Options.Output.empty())
-    Options.Output = "-";
+  if (!ServerSocket.empty()) {
+      if (Preambles) {
+          Env.Err << "moc-ng: --server cannot be used in a request to the server\n";
+          return EXIT_FAILURE;
+      }
+      // The other options given to the server are added to each request
+      std::vector<std::string> ServerArgs;
+      for (int I = 1; I < argc; ++I) {
+          if (I < ServerArgBegin || I >= ServerArgEnd)
+              ServerArgs.push_back(argv[I]);
+      }
+      llvm::SmallString<128> Directory;
+      if (llvm::sys::fs::createUniqueDirectory("moc-ng-preamble", Directory)) {
+          Env.Err << "moc-ng: cannot create a temporary directory\n";
+          return EXIT_FAILURE;
+      }
+      int Status;
+      {
+          PreambleCache ServerPreambles(Directory.str(), /*Persistent=*/false);
+          Status = RunMocServer(ServerSocket, [&](int argc, const char **argv, llvm::StringRef WorkingDir,
+                                                  int OutFd, int ErrFd) {
+              std::vector<const char *> Args(argv, argv + argc);
+              for (size_t I = 0; I < ServerArgs.size(); ++I)
+                  Args.insert(Args.begin() + 1 + I, ServerArgs[I].c_str());
+              llvm::raw_fd_ostream Out(OutFd, /*shouldClose=*/false);
+              llvm::raw_fd_ostream Err(ErrFd, /*shouldClose=*/false, /*unbuffered=*/true);
+              MocEnvironment RequestEnv { WorkingDir.str(), Out, Err };
+              int Status = RunMoc(Args.size(), Args.data(), RequestEnv, &ServerPreambles);
+              Out.flush();
+              // The client may be gone, which must not abort the server.
+              Out.clear_error();
+              Err.clear_error();
+              return Status;
+          });
+      }
+      // The precompiled headers were removed with ServerPreambles
+      llvm::sys::fs::remove(Directory);
+      return Status;
+  }
 
-  if (!HasInput)
-    Argv.push_back("-");
+  if (Batch) {
+      if (!Options.Output.empty()) {
+          Env.Err << "moc-ng: -o cannot be used with --batch\n";
+          return EXIT_FAILURE;
+      }
+      if (PreprocessorOnly) {
+          Env.Err << "moc-ng: -E cannot be used with --batch\n";
+          return EXIT_FAILURE;
+      }
+      if (!DepFile.empty()) {
+          Env.Err << "moc-ng: -MF cannot be used with --batch (use -MD)\n";
+          return EXIT_FAILURE;
+      }
+      if (!DepTarget.empty()) {
+          Env.Err << "moc-ng: -MT cannot be used with --batch\n";
+          return EXIT_FAILURE;
+      }
+      for (llvm::StringRef In : Inputs) {
+          size_t Eq = In.find('=');
+          if (Eq == llvm::StringRef::npos || Eq == 0 || Eq + 1 == In.size()) {
+              Env.Err << "moc-ng: batch inputs must be given as <header-file>=<output-file>: '"
+                      << In << "'\n";
+              return EXIT_FAILURE;
+          }
+          Jobs.push_back({In.substr(0, Eq).str(), In.substr(Eq + 1).str(), {}});
+      }
+  } else {
+      if (Inputs.size() > 1) {
+          Env.Err << "error: Too many input files specified\n";
+          return EXIT_FAILURE;
+      }
+      if (Options.Output.empty())
+        Options.Output = "-";
+      // The depfile is named after the output, which is also the target of its rule
+      if (GenerateDepFile && Options.Output == "-") {
+          if (DepFile.empty()) {
+              Env.Err << "moc-ng: -MD needs an output file: use -o, or -MF to name the depfile\n";
+              return EXIT_FAILURE;
+          }
+          if (DepTarget.empty()) {
+              Env.Err << "moc-ng: the output is written to stdout: use -MT to name the target of the depfile\n";
+              return EXIT_FAILURE;
+          }
+      }
+      Jobs.push_back({Inputs.empty() ? std::string() : Inputs.front().str(),
+                      Options.Output, Options.OutputTemplateHeader});
+  }
 
   //FIXME
   Argv.push_back("-I/usr/include/qt5");
@@ -443,36 +1649,115 @@ invalidArg:
 
   Argv.push_back("-I/builtins");
 
-  clang::FileManager FM({"."});
-  FM.Retain();
-
   if (PreprocessorOnly) {
+      clang::FileManager FM({Env.WorkingDir});
+      FM.Retain();
       Argv.push_back("-P");
+      Argv.push_back(Jobs.front().InputFile.empty() ? "-" : Jobs.front().InputFile);
       clang::tooling::ToolInvocation Inv(Argv, new clang::PrintPreprocessedAction, &FM);
       return !Inv.run();
   }
 
   Argv.push_back("-fsyntax-only");
 
-  if (!InputFile.endswith("qobject.h") && !InputFile.endswith("qnamespace.h")) {
-      // QObject should always be included
-      // But not not for qobject.h (or we would not detect the main file correctly) or
-      // qnamespace.h (that would break the Q_MOC_RUN workaround from MocPPCallbacks::EnterMainFile)
-      Argv.push_back("-include");
-      Argv.push_back("QtCore/qobject.h");
-  }
+  if (!SizeReportFile.empty())
+      Options.Sizes = &Sizes;
 
-  clang::tooling::ToolInvocation Inv(Argv, new MocAction, &FM);
+  // moc-ng itself opens the files by their absolute path, clang resolves the relative paths with
+  // -working-directory.
+  Options.CacheDir = Env.absolute(Options.CacheDir);
+  PCHCacheDir = Env.absolute(PCHCacheDir);
+  SizeReportFile = Env.absolute(SizeReportFile);
 
-  const EmbeddedFile *f = EmbeddedFiles;
-  while (f->filename) {
-      Inv.mapVirtualFile(f->filename, {f->content , f->size } );
-      f++;
+  if (!Options.CacheDir.empty() && llvm::sys::fs::create_directories(Options.CacheDir)) {
+      Env.Err << "moc-ng: cannot create the directory " << Options.CacheDir << "\n";
+      return EXIT_FAILURE;
   }
 
-  return !Inv.run();
-}
+  std::unique_ptr<PreambleCache> PersistentPreambles;
+  if (!PCHCacheDir.empty()) {
+      if (llvm::sys::fs::create_directories(PCHCacheDir)) {
+          Env.Err << "moc-ng: cannot create the directory " << PCHCacheDir << "\n";
+          return EXIT_FAILURE;
+      }
+      PersistentPreambles.reset(new PreambleCache(PCHCacheDir, /*Persistent=*/true));
+      Preambles = PersistentPreambles.get();
+  }
+
+  // The jobs are picked one by one from the list by the workers, so a worker which is done with
+  // a small header immediately takes the next one.
+  std::atomic<size_t> NextJob(0);
+  std::atomic<bool> Success(true);
+  std::mutex TimingsMutex;
+  auto Worker = [&] {
+      // Shared by all the jobs of this worker, so the files that are common to all the headers
+      // (Qt headers) are only looked up once.  (The FileManager is not thread safe)
+      clang::FileManager FM({Env.WorkingDir});
+      FM.Retain();
+      size_t J;
+      while ((J = NextJob++) < Jobs.size()) {
+          const MocJob &Job = Jobs[J];
+          MocOptions JobOptions = Options;
+          JobOptions.Output = Env.absolute(Job.Output);
+          JobOptions.OutputTemplateHeader = Env.absolute(Job.OutputTemplateHeader);
+          JobOptions.DepFileTarget = DepTarget.empty() ? Job.Output : DepTarget;
+          if (!DepFile.empty())
+              JobOptions.DepFile = Env.absolute(DepFile);
+          else if (GenerateDepFile && Job.Output != "-")
+              JobOptions.DepFile = Env.absolute(Job.Output + ".d");
+          auto Start = std::chrono::steady_clock::now();
+          if (!RunMocJob(Argv, Job.InputFile, JobOptions, &FM, Preambles))
+              Success = false;
+          if (ShowTimings) {
+              auto Elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+                  std::chrono::steady_clock::now() - Start);
+              std::lock_guard<std::mutex> Lock(TimingsMutex);
+              Env.Err << "moc-ng: " << (Job.InputFile.empty() ? "<stdin>" : Job.InputFile)
+                      << ": " << Elapsed.count() << " ms\n";
+          }
+      }
+  };
+
+  if (NumThreads == 0)
+      NumThreads = std::max(1u, std::thread::hardware_concurrency());
+  NumThreads = std::min<size_t>(NumThreads, Jobs.size());
+  if (NumThreads <= 1) {
+      Worker();
+  } else {
+      std::vector<std::thread> Threads;
+      for (unsigned T = 0; T < NumThreads; ++T)
+          Threads.emplace_back(Worker);
+      for (std::thread &T : Threads)
+          T.join();
+  }
 
+  if (!SizeReportFile.empty() && !Sizes.write(SizeReportFile)) {
+      Env.Err << "moc-ng: cannot write " << SizeReportFile << "\n";
+      return EXIT_FAILURE;
+  }
 
+  return Success ? EXIT_SUCCESS : EXIT_FAILURE;
+}
 
+int main(int argc, const char **argv)
+{
+  // -E writes to the standard output from within clang, so it is not forwarded, and neither is
+  // the start of another server.
+  bool Local = std::any_of(argv + 1, argv + argc, [](const char *A) {
+      return llvm::StringRef(A) == "-E" || llvm::StringRef(A).startswith("--server");
+  });
+  if (const char *Server = getenv("MOCNG_SERVER")) {
+      int Status = Local ? -1 : RunMocClient(Server, argc, argv);
+      if (Status >= 0)
+          return Status;
+      // The server is not running, do the work ourself.
+  }
 
+  llvm::SmallString<256> Cwd;
+  if (llvm::sys::fs::current_path(Cwd)) {
+      std::cerr << "moc-ng: cannot get the current directory" << std::endl;
+      return EXIT_FAILURE;
+  }
+  MocEnvironment Env { Cwd.str().str(), llvm::outs(), llvm::errs() };
+  return RunMoc(argc, argv, Env, nullptr);
+}
@@ -25,6 +25,7 @@
 #include <clang/AST/DeclTemplate.h>
 #include <clang/Sema/Sema.h>
 #include <clang/Basic/MacroBuilder.h>
+#include <clang/Lex/PreprocessorOptions.h>
 
 
 void MocASTConsumer::Initialize(clang::ASTContext& Ctx) {
@@ -63,7 +64,7 @@ void MocASTConsumer::HandleTagDeclDefinition(clang::TagDecl* D)
 
     clang::ClassTemplateSpecializationDecl* TD = llvm::dyn_cast<clang::ClassTemplateSpecializationDecl>(RD);
     if (TD && TD->getIdentifier() && TD->getName() == "QMetaTypeId" && TD->getTemplateArgs().size() == 1) {
-        Moc.registered_meta_type.insert(TD->getTemplateArgs().get(0).getAsType()->getCanonicalTypeUnqualified().getTypePtr());
+        Moc.AddRegisteredMetaType(TD->getTemplateArgs().get(0).getAsType());
     }
 
     if (TD) {
@@ -89,6 +90,36 @@ void MocASTConsumer::HandleTagDeclDefinition(clang::TagDecl* D)
     }
 }
 
+void MocASTConsumer::CollectPrecompiledMetaTypes()
+{
+    if (ci.getPreprocessorOpts().ImplicitPCHInclude.empty())
+        return;
+    clang::DeclContext *Contexts[2] = { ctx->getTranslationUnitDecl(), nullptr };
+    // When Qt is built with QT_NAMESPACE, QMetaTypeId is declared in that namespace
+    clang::Preprocessor &PP = ci.getPreprocessor();
+    if (auto *MI = PP.getMacroInfo(PP.getIdentifierInfo("QT_NAMESPACE"))) {
+        if (MI->getNumTokens() == 1 && MI->getReplacementToken(0).getIdentifierInfo()) {
+            for (auto *D : ctx->getTranslationUnitDecl()->lookup(MI->getReplacementToken(0).getIdentifierInfo())) {
+                if ((Contexts[1] = llvm::dyn_cast<clang::NamespaceDecl>(D)))
+                    break;
+            }
+        }
+    }
+    for (clang::DeclContext *DC : Contexts) {
+        if (!DC)
+            continue;
+        for (auto *D : DC->lookup(&ctx->Idents.get("QMetaTypeId"))) {
+            auto *CTD = llvm::dyn_cast<clang::ClassTemplateDecl>(D);
+            if (!CTD)
+                continue;
+            for (auto *TD : CTD->specializations()) {
+                if (TD->isCompleteDefinition() && TD->getTemplateArgs().size() == 1)
+                    Moc.AddRegisteredMetaType(TD->getTemplateArgs().get(0).getAsType());
+            }
+        }
+    }
+}
+
 bool MocASTConsumer::HandleTopLevelDecl(clang::DeclGroupRef D)
 {
     for (clang::Decl *Decl : D) {
@@ -47,6 +47,11 @@ public:
 
     virtual bool shouldParseDecl(clang::Decl *D) { return true; }
 
+protected:
+    // The declarations coming from a precompiled header are not passed to HandleTagDeclDefinition.
+    // Look up the QMetaTypeId specializations they contain.
+    void CollectPrecompiledMetaTypes();
+
 private:
     void HandleNamespaceDefinition(clang::NamespaceDecl *D);
 };
@@ -446,19 +446,24 @@ ClassDef MocNg::parseClass(clang::CXXRecordDecl* RD, clang::Sema& Sema)
     }
 
     //Check notify Signals
+    llvm::StringMap<std::pair<int, clang::CXXMethodDecl *>> SignalsByName;
+    if (!Def.Properties.empty()) {
+        int Idx = 0;
+        for (clang::CXXMethodDecl *MD : Def.Signals) {
+            auto &Entry = SignalsByName[MD->getName()];
+            if (!Entry.second) // keep the first overload
+                Entry = std::make_pair(Idx, MD);
+            Idx += 1 + MD->getNumParams() - MD->getMinRequiredArguments();
+        }
+    }
     for (PropertyDef &P: Def.Properties) {
         if (!P.notify.Str.empty()) {
-            int Idx = 0;
             auto errorLevel = clang::DiagnosticsEngine::Error;
-            for (clang::CXXMethodDecl *MD : Def.Signals) {
-                if (MD->getName() == P.notify.Str) {
-                    P.notify.notifyId = Idx;
-                    P.notify.MD = MD;
-                    break;
-                }
-                Idx += 1 + MD->getNumParams() - MD->getMinRequiredArguments();
-            }
-            if (P.notify.notifyId < 0 ) {
+            auto SignalIt = SignalsByName.find(P.notify.Str);
+            if (SignalIt != SignalsByName.end()) {
+                P.notify.notifyId = SignalIt->second.first;
+                P.notify.MD = SignalIt->second.second;
+            } else {
                 // Search in base classes
                 clang::CXXRecordDecl *Base = Def.Record;
                 do {
@@ -467,25 +472,17 @@ ClassDef MocNg::parseClass(clang::CXXRecordDecl* RD, clang::Sema& Sema)
                     Base = Base->bases_begin()->getType()->getAsCXXRecordDecl();
                     if (!Base)
                         break;
-                    for (auto it = Base->decls_begin(); it != Base->decls_end(); ++it) {
-                        if (auto *MD = llvm::dyn_cast<clang::CXXMethodDecl>(*it)) {
-
-                            if (MD->getIdentifier() && MD->getName() == P.notify.Str) {
-                                // We found a possible match. Check if it is indeed a signal
-                                if (std::any_of(MD->specific_attr_begin<clang::AnnotateAttr>(),
-                                                MD->specific_attr_end<clang::AnnotateAttr>(),
-                                                [&](const clang::AnnotateAttr *a) {
-                                                    return a->getAnnotation() == "qt_signal";
-                                                })) {
-                                    P.notify.MD = MD;
-                                    break;
-                                }
-                                // Since the official moc let this compile and the runtime will show
-                                // a warning, we just change the level to Warning.
-                                // (required for tst_qmetaobject which tests that)
-                                errorLevel = clang::DiagnosticsEngine::Warning;
-                            }
-                        }
+                    const auto &Candidates = BaseNotifyCandidates(Base);
+                    auto It = Candidates.find(P.notify.Str);
+                    if (It == Candidates.end())
+                        continue;
+                    if (It->second) {
+                        P.notify.MD = It->second;
+                    } else {
+                        // Since the official moc let this compile and the runtime will show
+                        // a warning, we just change the level to Warning.
+                        // (required for tst_qmetaobject which tests that)
+                        errorLevel = clang::DiagnosticsEngine::Warning;
                     }
                 } while(!P.notify.MD);
             }
@@ -501,6 +498,8 @@ ClassDef MocNg::parseClass(clang::CXXRecordDecl* RD, clang::Sema& Sema)
         if (P.revision > 0)
             Def.RevisionPropertyCount++;
     }
+
+    AssignTags(Def, PP.getSourceManager());
     return Def;
 }
 
@@ -526,32 +525,90 @@ NamespaceDef MocNg::parseNamespace(clang::NamespaceDecl* ND, clang::Sema& Sema)
     return Def;
 }
 
-std::string MocNg::GetTag(clang::SourceLocation DeclLoc, const clang::SourceManager &SM)
+const llvm::StringMap<clang::CXXMethodDecl *> &MocNg::BaseNotifyCandidates(const clang::CXXRecordDecl *RD)
 {
-    clang::SourceLocation FileLoc = SM.getFileLoc(DeclLoc);
-    clang::FileID FID = SM.getFileID(FileLoc);
-    const llvm::MemoryBuffer *Buffer = SM.getBuffer(FID);
-    const char *B = Buffer->getBufferStart();
-    int Off = SM.getFileOffset(FileLoc);
-    int Orig = Off;
-    while (Off > 0 && B[Off] != ';' && B[Off]!=',' && B[Off] != '}' && B[Off] != ':' /*&& B[Off] != '\n'*/ ) {
-        Off--;
+    auto Cached = NotifyCandidates.find(RD);
+    if (Cached != NotifyCandidates.end())
+        return Cached->second;
+    auto &Candidates = NotifyCandidates[RD];
+    for (auto it = RD->decls_begin(); it != RD->decls_end(); ++it) {
+        auto *MD = llvm::dyn_cast<clang::CXXMethodDecl>(*it);
+        if (!MD || !MD->getIdentifier())
+            continue;
+        clang::CXXMethodDecl *&Signal = Candidates[MD->getName()];
+        if (!Signal && std::any_of(MD->specific_attr_begin<clang::AnnotateAttr>(),
+                                   MD->specific_attr_end<clang::AnnotateAttr>(),
+                                   [&](const clang::AnnotateAttr *a) {
+                                       return a->getAnnotation() == "qt_signal";
+                                   })) {
+            Signal = MD;
+        }
     }
+    return Candidates;
+}
 
-    auto it_before = Tags.lower_bound(FileLoc.getLocWithOffset(Off - Orig));
-    auto it_after = Tags.upper_bound(FileLoc);
-    if (it_before != Tags.end() && it_after != Tags.begin() && it_before == (--it_after)) {
-        return it_before->second;
+// A tag belongs to a method if it is the only one between the end of the previous declaration
+// and the start of the method. The declarations of the class and the tags are both in the order
+// of the source, so they are merged in one pass.
+void MocNg::AssignTags(ClassDef &Def, const clang::SourceManager &SM)
+{
+    if (Tags.empty())
+        return;
+    if (SortedTags != Tags.size()) {
+        // The tags are in order within a file, but not across the includes.
+        auto Mid = Tags.begin() + SortedTags;
+        std::sort(Mid, Tags.end());
+        std::inplace_merge(Tags.begin(), Mid, Tags.end());
+        SortedTags = Tags.size();
+    }
+
+    auto Decompose = [&](clang::SourceLocation Loc) { return SM.getDecomposedLoc(SM.getFileLoc(Loc)); };
+    auto Prev = Decompose(Def.Record->getSourceRange().getBegin());
+    auto T = std::lower_bound(Tags.begin(), Tags.end(), TagDef{Prev, {}});
+    if (T == Tags.end())
+        return;
+
+    for (auto it = Def.Record->decls_begin(); it != Def.Record->decls_end(); ++it) {
+        if (it->isImplicit())
+            continue;
+        auto Range = it->getSourceRange();
+        auto Begin = Decompose(Range.getBegin());
+        while (T != Tags.end() && T->Loc <= Prev)
+            ++T;
+        const TagDef *Found = nullptr;
+        bool Ambiguous = false;
+        for (; T != Tags.end() && T->Loc <= Begin; ++T) {
+            // The same location is recorded twice if the tag is used within another macro
+            if (Found && Found->Loc != T->Loc)
+                Ambiguous = true;
+            Found = &*T;
+        }
+        if (Found && !Ambiguous) {
+            if (auto M = llvm::dyn_cast<clang::CXXMethodDecl>(*it))
+                Def.MethodTags[M] = Found->Name;
+        }
+        if (T == Tags.end())
+            return;
+        Prev = std::max(Prev, Decompose(Range.getEnd()));
     }
-    return {};
 }
 
-bool MocNg::ShouldRegisterMetaType(clang::QualType T)
+void MocNg::AddRegisteredMetaType(clang::QualType T)
+{
+    const clang::Type *Key = T->getCanonicalTypeUnqualified().getTypePtr();
+    if (registered_meta_type.count(Key))
+        return;
+    registered_meta_type.insert(Key);
+    // A type that could not be registered before might now be
+    ShouldRegisterCache.clear();
+}
+
+static bool ComputeShouldRegisterMetaType(MocNg &Moc, clang::QualType T)
 {
     if (T->isVoidType() || (T->isReferenceType() && !T.getNonReferenceType().isConstQualified()))
         return false;
 
-    if (registered_meta_type.count(T->getCanonicalTypeUnqualified().getTypePtr()))
+    if (Moc.registered_meta_type.count(T->getCanonicalTypeUnqualified().getTypePtr()))
         return true;
 
     T = T.getNonReferenceType();
@@ -574,10 +631,22 @@ bool MocNg::ShouldRegisterMetaType(clang::QualType T)
         for (uint I = 0; I < TD->getTemplateArgs().size(); ++I) {
             const auto &Arg = TD->getTemplateArgs().get(I);
             if (Arg.getKind() == clang::TemplateArgument::Type) {
-                if (!ShouldRegisterMetaType(Arg.getAsType()))
+                if (!Moc.ShouldRegisterMetaType(Arg.getAsType()))
                     return false;
             }
         }
     }
     return true;
 }
+
+bool MocNg::ShouldRegisterMetaType(clang::QualType T)
+{
+    // The result only depends on the canonical type (the const of a reference is part of it)
+    const clang::Type *Key = T->getCanonicalTypeUnqualified().getTypePtr();
+    auto Cached = ShouldRegisterCache.find(Key);
+    if (Cached != ShouldRegisterCache.end())
+        return Cached->second;
+    bool Result = ComputeShouldRegisterMetaType(*this, T);
+    ShouldRegisterCache[Key] = Result;
+    return Result;
+}
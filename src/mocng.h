@@ -23,9 +23,11 @@
 #include <vector>
 #include <iterator>
 #include <algorithm>
-#include <set>
 #include <unordered_map>
 #include <clang/Basic/SourceLocation.h>
+#include <llvm/ADT/DenseMap.h>
+#include <llvm/ADT/SmallPtrSet.h>
+#include <llvm/ADT/StringMap.h>
 #include "qbjs.h"
 #include "clangversionabstraction.h"
 
@@ -43,6 +45,13 @@ class Type;
 class QualType;
 }
 
+// A macro defined within Q_MOC_RUN, expanded in front of a method declaration
+struct TagDef {
+    std::pair<clang::FileID, unsigned> Loc; // File and offset of the expansion
+    std::string Name;
+    bool operator<(const TagDef &Other) const { return Loc < Other.Loc; }
+};
+
 struct NotifyDef {
     std::string Str;
     clang::SourceLocation Loc;
@@ -112,6 +121,8 @@ struct ClassDef : BaseDef {
     std::vector<clang::CXXMethodDecl*> Methods;
     std::vector<clang::CXXConstructorDecl*> Constructors;
 
+    // The tag of the methods which have one
+    std::unordered_map<const clang::CXXMethodDecl*, std::string> MethodTags;
 
     std::vector<std::string> Interfaces;
     PluginData Plugin;
@@ -135,8 +146,10 @@ struct NamespaceDef : BaseDef {
 class MocNg {
 public:
 
-    typedef std::set<const clang::Type*> MetaTypeSet;
+    // The canonical types with a QMetaTypeId specialization. Use AddRegisteredMetaType to add to it.
+    typedef llvm::SmallPtrSet<const clang::Type*, 32> MetaTypeSet;
     MetaTypeSet registered_meta_type;
+    void AddRegisteredMetaType(clang::QualType T);
 
     typedef std::unordered_map<std::string, const clang::CXXRecordDecl*> InterfaceMap;
     InterfaceMap interfaces;
@@ -146,7 +159,20 @@ public:
 
     bool HasPlugin = false;
 
-    std::map<clang::SourceLocation, std::string> Tags;
-    std::string GetTag(clang::SourceLocation DeclLoc, const clang::SourceManager& SM);
+    // Filled by MocPPCallbacks in the order of the expansions. Sorted up to SortedTags.
+    std::vector<TagDef> Tags;
+    std::size_t SortedTags = 0;
+    void AssignTags(ClassDef &Def, const clang::SourceManager &SM);
     bool ShouldRegisterMetaType(clang::QualType T);
+    // Result of ShouldRegisterMetaType for the canonical types, for the whole translation unit
+    llvm::DenseMap<const clang::Type*, bool> ShouldRegisterCache;
+
+    // For each name of a method of the class, its first signal with that name, or null if none of
+    // the methods with that name is a signal. Used to resolve the NOTIFY of the derived classes.
+    const llvm::StringMap<clang::CXXMethodDecl *> &BaseNotifyCandidates(const clang::CXXRecordDecl *RD);
+    std::unordered_map<const clang::CXXRecordDecl *, llvm::StringMap<clang::CXXMethodDecl *>> NotifyCandidates;
+
+    // Cache of the normalized type names computed by Generator::GenerateTypeInfo.
+    // Not keyed on the canonical type because the name of typedefs must be kept.
+    std::unordered_map<void *, std::string> TypeNames;
 };
@@ -19,6 +19,9 @@
 
 #include "mocppcallbacks.h"
 #include "clangversionabstraction.h"
+#include <clang/Lex/HeaderSearch.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/Path.h>
 
 void MocPPCallbacks::InjectQObjectDefs(clang::SourceLocation Loc) {
     #include "qobjectdefs-injected.h"
@@ -53,6 +56,13 @@ void MocPPCallbacks::FileChanged(clang::SourceLocation Loc, clang::PPCallbacks::
         EnterMainFile(SM.getFilename(Loc));
     }
 
+    if (Dependencies && Reason == EnterFile) {
+        // The injected buffer has no file entry, and the embedded files are not on the disk
+        auto F = SM.getFileEntryForID(SM.getFileID(SM.getFileLoc(Loc)));
+        if (F && !llvm::StringRef(F->getName()).startswith("/builtins/"))
+            Dependencies->push_back(llvm::StringRef(F->getName()).str());
+    }
+
     if (Reason != ExitFile)
         return;
     auto F = PP.getSourceManager().getFileEntryForID(PrevFID);
@@ -94,4 +104,46 @@ void MocPPCallbacks::InclusionDirective(clang::SourceLocation HashLoc, const cla
             << FileName << FilenameRange;
     }
     ShouldWarnHeaderNotFound = false;
+    if (AbsentFiles)
+        AddAbsentIncludes(PP, HashLoc, FileName, IsAngled, *AbsentFiles);
+}
+
+void AddAbsentIncludes(clang::Preprocessor &PP, clang::SourceLocation HashLoc, llvm::StringRef FileName,
+                       bool IsAngled, std::vector<std::string> &AbsentFiles)
+{
+    auto Absolute = [&](llvm::StringRef Path) {
+        llvm::SmallString<256> Result(Path);
+        if (!llvm::sys::path::is_absolute(Result)) {
+            Result = PP.getFileManager().getFileSystemOpts().WorkingDir;
+            llvm::sys::path::append(Result, Path);
+        }
+        return Result.str().str();
+    };
+    // Stop at the first candidate which exists: it is the file that was included.
+    auto Add = [&](llvm::StringRef Dir) {
+        llvm::SmallString<256> Candidate(Dir);
+        llvm::sys::path::append(Candidate, FileName);
+        std::string Path = Absolute(Candidate);
+        if (llvm::sys::fs::exists(Path))
+            return false;
+        AbsentFiles.push_back(std::move(Path));
+        return true;
+    };
+
+    if (llvm::sys::path::is_absolute(FileName)) {
+        Add({});
+        return;
+    }
+    clang::SourceManager &SM = PP.getSourceManager();
+    if (!IsAngled) {
+        auto Includer = SM.getFileEntryForID(SM.getFileID(SM.getFileLoc(HashLoc)));
+        if (Includer && !Add(llvm::sys::path::parent_path(llvm::StringRef(Includer->getName()))))
+            return;
+    }
+    clang::HeaderSearch &HS = PP.getHeaderSearchInfo();
+    for (auto It = IsAngled ? HS.angled_dir_begin() : HS.search_dir_begin(); It != HS.search_dir_end(); ++It) {
+        // The frameworks and the header maps are not followed.
+        if (It->isNormalDir() && !Add(llvm::StringRef(It->getName())))
+            return;
+    }
 }
@@ -19,7 +19,14 @@
 
 #include <clang/Lex/Preprocessor.h>
 #include <clang/Basic/Version.h>
-#include <set>
+#include <llvm/ADT/SmallPtrSet.h>
+#include "mocng.h"
+#include <vector>
+
+// Add to AbsentFiles the absolute paths where the preprocessor looked for this include before
+// finding it (all of them if it was not found): if one of them appears, it is included instead.
+void AddAbsentIncludes(clang::Preprocessor &PP, clang::SourceLocation HashLoc, llvm::StringRef FileName,
+                       bool IsAngled, std::vector<std::string> &AbsentFiles);
 
 class MocPPCallbacks : public clang::PPCallbacks {
     clang::Preprocessor &PP;
@@ -27,14 +34,29 @@ class MocPPCallbacks : public clang::PPCallbacks {
     bool IncludeNotFoundSupressed = false;
     bool ShouldWarnHeaderNotFound = false;
     bool InQMOCRUN = false;
-    std::set<std::string> PossibleTags;
-    std::map<clang::SourceLocation, std::string> &Tags;
+    // The macros defined within a Q_MOC_RUN block. MacroExpands is called for every expansion,
+    // so compare the IdentifierInfo pointers rather than the names.
+    llvm::SmallPtrSet<const clang::IdentifierInfo *, 16> PossibleTags;
+    std::vector<TagDef> &Tags;
+    const clang::IdentifierInfo *MocRunII;
+    const clang::IdentifierInfo *NoKeywordsII;
 
 public:
 
-    MocPPCallbacks(clang::Preprocessor &PP, std::map<clang::SourceLocation, std::string> &Tags) : PP(PP), Tags(Tags) {}
+    MocPPCallbacks(clang::Preprocessor &PP, std::vector<TagDef> &Tags)
+        : PP(PP), Tags(Tags), MocRunII(PP.getIdentifierInfo("Q_MOC_RUN")),
+          NoKeywordsII(PP.getIdentifierInfo("QT_NO_KEYWORDS")) {}
 
     bool IsInMainFile = false;
+    // If set, the files entered by the preprocessor are added to it (for the depfile)
+    std::vector<std::string> *Dependencies = nullptr;
+    // If set, the files which would change the result if they existed are added to it (see
+    // AddAbsentIncludes), so that a cached result can be invalidated when one of them appears.
+    std::vector<std::string> *AbsentFiles = nullptr;
+    // If set, the names of the macros defined within a Q_MOC_RUN block are added to it, so they
+    // can be saved with a precompiled header and given back to AddPossibleTag when it is loaded.
+    std::vector<std::string> *TagNames = nullptr;
+    void AddPossibleTag(llvm::StringRef Name) { PossibleTags.insert(PP.getIdentifierInfo(Name)); }
     void InjectQObjectDefs(clang::SourceLocation Loc);
     void EnterMainFile(clang::StringRef Name);
 
@@ -57,7 +79,7 @@ protected:
 #endif
                         ) override {
         //Workaround to get moc's test to compile
-        if (MacroNameTok.getIdentifierInfo()->getName() == "QT_NO_KEYWORDS") {
+        if (MacroNameTok.getIdentifierInfo() == NoKeywordsII) {
             //re-inject qobjectdefs
             InjectQObjectDefs(MacroNameTok.getLocation());
         }
@@ -79,7 +101,7 @@ protected:
             , clang::SourceRange = {}
 #endif
     ) override {
-        if (MacroNameTok.getIdentifierInfo()->getName() != "Q_MOC_RUN")
+        if (MacroNameTok.getIdentifierInfo() != MocRunII)
             return;
         auto F = PP.getSourceManager().getFileEntryForID(PP.getSourceManager().getFileID(MacroNameTok.getLocation()));
         if (!F) return;
@@ -107,7 +129,10 @@ protected:
     void MacroDefined(const clang::Token& MacroNameTok, MacroParam2) override {
         if (!InQMOCRUN)
             return;
-        PossibleTags.insert(MacroNameTok.getIdentifierInfo()->getName());
+        const clang::IdentifierInfo *II = MacroNameTok.getIdentifierInfo();
+        if (TagNames && !PossibleTags.count(II))
+            TagNames->push_back(II->getName());
+        PossibleTags.insert(II);
     }
 
 
@@ -117,9 +142,10 @@ protected:
 #endif
     ) override {
         if (InQMOCRUN) return;
-        if (PossibleTags.count(MacroNameTok.getIdentifierInfo()->getName())) {
-            clang::SourceLocation FileLoc = PP.getSourceManager().getFileLoc(MacroNameTok.getLocation());
-            Tags.insert({FileLoc, MacroNameTok.getIdentifierInfo()->getName()});
+        const clang::IdentifierInfo *II = MacroNameTok.getIdentifierInfo();
+        if (PossibleTags.count(II)) {
+            const clang::SourceManager &SM = PP.getSourceManager();
+            Tags.push_back({SM.getDecomposedLoc(SM.getFileLoc(MacroNameTok.getLocation())), II->getName()});
         }
     }
 
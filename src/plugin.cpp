@@ -91,6 +91,7 @@ class MocPluginASTConsumer : public MocASTConsumer {
       if (Tok.is(clang::tok::eof)) {
         done = true;
         PP.CommitBacktrackedTokens();
+        CollectPrecompiledMetaTypes();
         std::string code = generate();
         if (!code.empty()) {
           objects.clear();
@@ -0,0 +1,275 @@
+/****************************************************************************
+ *  Copyright (C) 2013-2016 Woboq GmbH
+ *  Olivier Goffart <contact at woboq.com>
+ *  https://woboq.com/
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "server.h"
+
+#include <llvm/ADT/SmallString.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/Path.h>
+
+#include <iostream>
+#include <cstring>
+#include <cerrno>
+#include <csignal>
+#include <cstdint>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+/* Protocol:
+ *  - The client sends a 32 bit length, with its stdout and stderr file descriptors attached,
+ *    followed by that many bytes: the working directory and the arguments, each terminated by '\0'.
+ *  - The server answers with the 32 bit exit code once the command is done.
+ * The request must arrive within RequestTimeout seconds, so a client that dies before sending
+ * everything does not keep a thread of the server waiting forever, and be at most MaxRequestSize
+ * bytes long.
+ * The requests run with the rights of the server, so only the user running it is served.
+ */
+
+enum { RequestTimeout = 30, MaxRequestSize = 4 << 20 };
+
+static volatile sig_atomic_t Stopping = 0;
+static void Stop(int) { Stopping = 1; }
+
+static bool FillAddress(llvm::StringRef SocketPath, sockaddr_un &Addr) {
+    memset(&Addr, 0, sizeof(Addr));
+    Addr.sun_family = AF_UNIX;
+    if (SocketPath.size() >= sizeof(Addr.sun_path)) {
+        std::cerr << "moc-ng: socket path too long: " << SocketPath.str() << std::endl;
+        return false;
+    }
+    memcpy(Addr.sun_path, SocketPath.data(), SocketPath.size());
+    return true;
+}
+
+static bool ReadAll(int Fd, void *Data, size_t Size) {
+    char *D = static_cast<char *>(Data);
+    while (Size) {
+        ssize_t R = read(Fd, D, Size);
+        if (R < 0 && errno == EINTR)
+            continue;
+        if (R <= 0)
+            return false;
+        D += R;
+        Size -= R;
+    }
+    return true;
+}
+
+static bool WriteAll(int Fd, const void *Data, size_t Size) {
+    const char *D = static_cast<const char *>(Data);
+    while (Size) {
+        ssize_t R = write(Fd, D, Size);
+        if (R < 0 && errno == EINTR)
+            continue;
+        if (R <= 0)
+            return false;
+        D += R;
+        Size -= R;
+    }
+    return true;
+}
+
+static bool IsSameUser(int Client) {
+#ifdef SO_PEERCRED
+    ucred Cred;
+    socklen_t Len = sizeof(Cred);
+    return getsockopt(Client, SOL_SOCKET, SO_PEERCRED, &Cred, &Len) == 0 && Cred.uid == getuid();
+#else
+    uid_t Uid;
+    gid_t Gid;
+    return getpeereid(Client, &Uid, &Gid) == 0 && Uid == getuid();
+#endif
+}
+
+static void HandleClient(int Client, const MocServerHandler &Handler) {
+    if (!IsSameUser(Client))
+        return;
+    timeval Timeout = { RequestTimeout, 0 };
+    setsockopt(Client, SOL_SOCKET, SO_RCVTIMEO, &Timeout, sizeof(Timeout));
+
+    uint32_t Size = 0;
+    int Fds[2] = { -1, -1 };
+
+    iovec Iov = { &Size, sizeof(Size) };
+    char Control[CMSG_SPACE(sizeof(Fds))];
+    msghdr Msg;
+    memset(&Msg, 0, sizeof(Msg));
+    Msg.msg_iov = &Iov;
+    Msg.msg_iovlen = 1;
+    Msg.msg_control = Control;
+    Msg.msg_controllen = sizeof(Control);
+    ssize_t Received = recvmsg(Client, &Msg, 0);
+
+    // Take all the descriptors that came with the message, so they are closed even if the
+    // request is invalid.
+    std::vector<int> ReceivedFds;
+    for (cmsghdr *C = Received >= 0 ? CMSG_FIRSTHDR(&Msg) : nullptr; C; C = CMSG_NXTHDR(&Msg, C)) {
+        if (C->cmsg_level != SOL_SOCKET || C->cmsg_type != SCM_RIGHTS)
+            continue;
+        for (size_t I = 0; I < (C->cmsg_len - CMSG_LEN(0)) / sizeof(int); ++I) {
+            int Fd;
+            memcpy(&Fd, CMSG_DATA(C) + I * sizeof(int), sizeof(int));
+            ReceivedFds.push_back(Fd);
+        }
+    }
+
+    int32_t Status = EXIT_FAILURE;
+    if (Received == sizeof(Size) && ReceivedFds.size() == 2 && Size <= MaxRequestSize) {
+        std::string Payload(Size, '\0');
+        std::vector<const char *> Argv;
+        if (Size && ReadAll(Client, &Payload[0], Size) && Payload.back() == '\0') {
+            for (size_t Pos = 0; Pos < Payload.size(); Pos = Payload.find('\0', Pos) + 1)
+                Argv.push_back(&Payload[Pos]);
+        }
+        // The first string is the working directory of the client.
+        if (Argv.size() >= 2 && llvm::sys::path::is_absolute(Argv.front()))
+            Status = Handler(Argv.size() - 1, Argv.data() + 1, Argv.front(), ReceivedFds[0], ReceivedFds[1]);
+    }
+    for (int Fd : ReceivedFds)
+        close(Fd);
+    WriteAll(Client, &Status, sizeof(Status));
+}
+
+int RunMocServer(llvm::StringRef SocketPath, const MocServerHandler &Handler)
+{
+    // Do not die if a client goes away.
+    signal(SIGPIPE, SIG_IGN);
+
+    sockaddr_un Addr;
+    if (!FillAddress(SocketPath, Addr))
+        return EXIT_FAILURE;
+
+    int Listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (Listener < 0) {
+        perror("moc-ng: socket");
+        return EXIT_FAILURE;
+    }
+    unlink(Addr.sun_path); // Remove the socket of a previous server.
+    if (bind(Listener, reinterpret_cast<sockaddr *>(&Addr), sizeof(Addr)) < 0
+            || listen(Listener, 64) < 0) {
+        perror("moc-ng: cannot listen");
+        close(Listener);
+        return EXIT_FAILURE;
+    }
+    std::cerr << "moc-ng: listening on " << SocketPath.str() << std::endl;
+
+    // Stop on SIGINT and SIGTERM, so the caller can clean up. Without SA_RESTART, they interrupt
+    // accept. They are blocked in the threads of the requests, so they reach this one.
+    struct sigaction Action;
+    memset(&Action, 0, sizeof(Action));
+    Action.sa_handler = Stop;
+    sigaction(SIGINT, &Action, nullptr);
+    sigaction(SIGTERM, &Action, nullptr);
+    sigset_t StopSignals, OldMask;
+    sigemptyset(&StopSignals);
+    sigaddset(&StopSignals, SIGINT);
+    sigaddset(&StopSignals, SIGTERM);
+
+    std::mutex Mutex;
+    std::condition_variable Done;
+    int Active = 0;
+    while (!Stopping) {
+        int Client = accept(Listener, nullptr, nullptr);
+        if (Client < 0) {
+            if (errno == EINTR)
+                continue;
+            perror("moc-ng: accept");
+            break;
+        }
+        {
+            std::lock_guard<std::mutex> Lock(Mutex);
+            ++Active;
+        }
+        pthread_sigmask(SIG_BLOCK, &StopSignals, &OldMask);
+        std::thread([Client, &Handler, &Mutex, &Done, &Active] {
+            HandleClient(Client, Handler);
+            close(Client);
+            std::lock_guard<std::mutex> Lock(Mutex);
+            if (--Active == 0)
+                Done.notify_all();
+        }).detach();
+        pthread_sigmask(SIG_SETMASK, &OldMask, nullptr);
+    }
+    close(Listener);
+    unlink(Addr.sun_path);
+
+    // The requests in progress use the state of the caller: wait for them.
+    std::unique_lock<std::mutex> Lock(Mutex);
+    Done.wait(Lock, [&] { return Active == 0; });
+    return Stopping ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+int RunMocClient(llvm::StringRef SocketPath, int argc, const char **argv)
+{
+    sockaddr_un Addr;
+    if (!FillAddress(SocketPath, Addr))
+        return -1;
+
+    llvm::SmallString<256> Cwd;
+    if (llvm::sys::fs::current_path(Cwd))
+        return -1;
+
+    int S = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (S < 0)
+        return -1;
+    if (connect(S, reinterpret_cast<sockaddr *>(&Addr), sizeof(Addr)) < 0) {
+        close(S);
+        return -1;
+    }
+    signal(SIGPIPE, SIG_IGN);
+
+    std::string Payload = Cwd.str().str();
+    Payload += '\0';
+    for (int I = 0; I < argc; ++I) {
+        Payload += argv[I];
+        Payload += '\0';
+    }
+
+    uint32_t Size = Payload.size();
+    int Fds[2] = { 1, 2 };
+    iovec Iov = { &Size, sizeof(Size) };
+    char Control[CMSG_SPACE(sizeof(Fds))];
+    memset(Control, 0, sizeof(Control));
+    msghdr Msg;
+    memset(&Msg, 0, sizeof(Msg));
+    Msg.msg_iov = &Iov;
+    Msg.msg_iovlen = 1;
+    Msg.msg_control = Control;
+    Msg.msg_controllen = sizeof(Control);
+    cmsghdr *C = CMSG_FIRSTHDR(&Msg);
+    C->cmsg_level = SOL_SOCKET;
+    C->cmsg_type = SCM_RIGHTS;
+    C->cmsg_len = CMSG_LEN(sizeof(Fds));
+    memcpy(CMSG_DATA(C), Fds, sizeof(Fds));
+
+    int32_t Status = -1;
+    if (sendmsg(S, &Msg, 0) != sizeof(Size) || !WriteAll(S, Payload.data(), Payload.size())
+            || !ReadAll(S, &Status, sizeof(Status))) {
+        Status = -1;
+    }
+    close(S);
+    return Status;
+}
@@ -0,0 +1,48 @@
+/****************************************************************************
+ *  Copyright (C) 2013-2016 Woboq GmbH
+ *  Olivier Goffart <contact at woboq.com>
+ *  https://woboq.com/
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <functional>
+#include <string>
+#include <vector>
+#include <llvm/ADT/StringRef.h>
+
+/* Persistent moc process.
+ * The server listens on a local socket and runs the command lines that the clients forward to it,
+ * so the state that is kept between requests (such as the precompiled QtCore header) stays warm.
+ * The client passes its stdout and stderr along with the request, so the output and the
+ * diagnostics end up where they would have been if the client had run moc itself.
+ */
+
+// Called for each request, from its own thread, with the arguments of the client (including
+// argv[0]), its working directory, and its stdout and stderr. The server process does not change
+// its working directory or its standard streams, so the relative paths must be resolved against
+// WorkingDir and the output written to OutFd and ErrFd, which are closed by the server after.
+// Returns the exit code for the client.
+typedef std::function<int(int argc, const char **argv, llvm::StringRef WorkingDir,
+                          int OutFd, int ErrFd)> MocServerHandler;
+
+// Listen on SocketPath and serve the requests, each one in its own thread. Returns EXIT_SUCCESS
+// on SIGINT or SIGTERM, once the requests in progress are done, or EXIT_FAILURE on error.
+int RunMocServer(llvm::StringRef SocketPath, const MocServerHandler &Handler);
+
+// Forward the command line to the server listening on SocketPath and return the exit code.
+// Returns -1 if the server could not be reached, in which case the caller should run moc itself.
+int RunMocClient(llvm::StringRef SocketPath, int argc, const char **argv);
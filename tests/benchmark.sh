@@ -0,0 +1,48 @@
+#!/bin/sh
+# Compare the time two moc binaries spend on the large headers of the tests, e.g. the builds
+# before and after a change:
+#     tests/benchmark.sh /path/to/old/moc /path/to/new/moc
+# Each header is processed RUNS times (default 5) and the median wall time is printed.
+# The Qt headers are found with qmake (set QMAKE to use another one).
+
+set -e
+if [ $# -ne 2 ]; then
+    echo "usage: $0 <old moc> <new moc>" >&2
+    exit 1
+fi
+OLD=$1
+NEW=$2
+RUNS=${RUNS:-5}
+QMAKE=${QMAKE:-qmake}
+TESTS=$(cd "$(dirname "$0")" && pwd)
+QT_HEADERS=$("$QMAKE" -query QT_INSTALL_HEADERS)
+INCLUDES="-I$QT_HEADERS -I$QT_HEADERS/QtCore -I$QT_HEADERS/QtGui -I$QT_HEADERS/QtWidgets -I$QT_HEADERS/QtTest"
+OUT=$(mktemp -d)
+trap 'rm -rf "$OUT"' EXIT
+
+# The headers:
+#  - largeclass: the string table of the generator (5000 members) and the resolution of the NOTIFY
+#    signals (800 properties with their own NOTIFY signal, one with a signal of the base class);
+#  - widgetstags: the preprocessor callbacks, which see every macro expansion of QtWidgets.
+HEADERS="
+largeclass/tst_largeclass.cpp
+widgetstags/tst_widgetstags.cpp
+"
+
+median() {
+    sort -n | awk '{ a[NR] = $1 } END { print a[int((NR + 1) / 2)] }'
+}
+
+time_moc() {
+    for I in $(seq "$RUNS"); do
+        START=$(date +%s%N)
+        "$1" $INCLUDES "$2" -o "$OUT/out.moc" 2>/dev/null
+        END=$(date +%s%N)
+        echo $(( (END - START) / 1000000 ))
+    done | median
+}
+
+printf "%-34s %10s %10s\n" "" old new
+for H in $HEADERS; do
+    printf "%-34s %7s ms %7s ms\n" "$H" "$(time_moc "$OLD" "$TESTS/$H")" "$(time_moc "$NEW" "$TESTS/$H")"
+done
@@ -0,0 +1,9 @@
+CONFIG += testcase
+CONFIG += parallel_test
+TARGET = tst_constexprdata
+
+SOURCES += tst_constexprdata.cpp
+
+QT = testlib
+
+QMAKE_MOC_OPTIONS += --constexpr-data
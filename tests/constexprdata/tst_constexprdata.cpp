@@ -0,0 +1,70 @@
+/****************************************************************************
+ *  Copyright (C) 2013-2016 Woboq GmbH
+ *  Olivier Goffart <contact at woboq.com>
+ *  https://woboq.com/
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <QtTest/QtTest>
+
+// Built with --constexpr-data
+
+class Object : public QObject
+{
+    Q_OBJECT
+    Q_CLASSINFO("escaped", "a\tb\"c\\d")
+    Q_CLASSINFO("trigraph", "what??!")
+    Q_CLASSINFO("digits", "42")
+    Q_CLASSINFO("utf8", "\xc3\xa9t\xc3\xa9")
+    Q_PROPERTY(int value READ value)
+public:
+    int value() const { return 1; }
+signals:
+    void changed(int value);
+};
+
+namespace NS {
+    Q_NAMESPACE
+    enum Mode { Off, On };
+    Q_ENUM_NS(Mode)
+}
+
+class tst_ConstexprData : public QObject
+{ Q_OBJECT
+private slots:
+    void strings();
+};
+
+void tst_ConstexprData::strings()
+{
+    const QMetaObject &mo = Object::staticMetaObject;
+    QCOMPARE(mo.className(), "Object");
+    QCOMPARE(mo.classInfo(mo.indexOfClassInfo("escaped")).value(), "a\tb\"c\\d");
+    QCOMPARE(mo.classInfo(mo.indexOfClassInfo("trigraph")).value(), "what?" "?!");
+    QCOMPARE(mo.classInfo(mo.indexOfClassInfo("digits")).value(), "42");
+    QCOMPARE(mo.classInfo(mo.indexOfClassInfo("utf8")).value(), "\xc3\xa9t\xc3\xa9");
+    QVERIFY(mo.indexOfSignal("changed(int)") >= 0);
+    QCOMPARE(mo.property(mo.indexOfProperty("value")).typeName(), "int");
+
+    Object o;
+    QCOMPARE(qobject_cast<Object*>(static_cast<QObject*>(&o)), &o);
+
+    QCOMPARE(NS::staticMetaObject.className(), "NS");
+    QCOMPARE(QMetaEnum::fromType<NS::Mode>().valueToKey(NS::On), "On");
+}
+
+QTEST_MAIN(tst_ConstexprData)
+
+#include "tst_constexprdata.moc"
@@ -0,0 +1,7 @@
+CONFIG += testcase
+CONFIG += parallel_test
+TARGET = tst_largeclass
+
+SOURCES += tst_largeclass.cpp
+
+QT = testlib
@@ -0,0 +1,147 @@
+/****************************************************************************
+ *  Copyright (C) 2013-2016 Woboq GmbH
+ *  Olivier Goffart <contact at woboq.com>
+ *  https://woboq.com/
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <QtTest/QtTest>
+
+/* A class with 5000 members, generated with macros:
+ * 1000 signals, 2000 slots, 1000 invokable methods and 1000 properties.
+ * Generating the meta object of such classes used to be quadratic in the number of strings.
+ */
+
+#define REPEAT10(M, P) M(P##0) M(P##1) M(P##2) M(P##3) M(P##4) M(P##5) M(P##6) M(P##7) M(P##8) M(P##9)
+#define REPEAT100(M, P) REPEAT10(M, P##0) REPEAT10(M, P##1) REPEAT10(M, P##2) REPEAT10(M, P##3) \
+    REPEAT10(M, P##4) REPEAT10(M, P##5) REPEAT10(M, P##6) REPEAT10(M, P##7) REPEAT10(M, P##8) REPEAT10(M, P##9)
+#define REPEAT1000(M, P) REPEAT100(M, P##0) REPEAT100(M, P##1) REPEAT100(M, P##2) REPEAT100(M, P##3) \
+    REPEAT100(M, P##4) REPEAT100(M, P##5) REPEAT100(M, P##6) REPEAT100(M, P##7) REPEAT100(M, P##8) REPEAT100(M, P##9)
+#define REPEAT800(M, P) REPEAT100(M, P##0) REPEAT100(M, P##1) REPEAT100(M, P##2) REPEAT100(M, P##3) \
+    REPEAT100(M, P##4) REPEAT100(M, P##5) REPEAT100(M, P##6) REPEAT100(M, P##7)
+
+#define DECLARE_SIGNAL(N) void signal_##N(int);
+#define DECLARE_SLOT(N) void slot_##N(int v) { last = v; } void otherSlot_##N(const QString &) {}
+#define DECLARE_INVOKABLE(N) Q_INVOKABLE int invokable_##N(int v) { return v + 1; }
+#define DECLARE_PROPERTY(N) Q_PROPERTY(int property_##N MEMBER member_##N) int member_##N = 0;
+#define DECLARE_NOTIFY_PROPERTY(N) \
+    Q_PROPERTY(int notified_##N MEMBER notifiedMember_##N NOTIFY notified_##N##Changed) int notifiedMember_##N = 0;
+#define DECLARE_NOTIFY_SIGNAL(N) void notified_##N##Changed();
+
+class LargeClass : public QObject
+{
+    Q_OBJECT
+public:
+    int last = 0;
+    REPEAT1000(DECLARE_INVOKABLE, n)
+    REPEAT1000(DECLARE_PROPERTY, n)
+signals:
+    REPEAT1000(DECLARE_SIGNAL, n)
+public slots:
+    REPEAT1000(DECLARE_SLOT, n)
+};
+
+class NotifyBase : public QObject
+{
+    Q_OBJECT
+signals:
+    void baseChanged();
+};
+
+/* 800 properties, each with its own NOTIFY signal, and one notified by a signal of the base class.
+ * The NOTIFY signals are looked up by name for each property.
+ */
+class NotifyClass : public NotifyBase
+{
+    Q_OBJECT
+    Q_PROPERTY(int inherited MEMBER inheritedMember NOTIFY baseChanged)
+public:
+    int inheritedMember = 0;
+    REPEAT800(DECLARE_NOTIFY_PROPERTY, n)
+signals:
+    REPEAT800(DECLARE_NOTIFY_SIGNAL, n)
+};
+
+class tst_LargeClass : public QObject
+{ Q_OBJECT
+private slots:
+    void counts();
+    void methods();
+    void properties();
+    void notifySignals();
+};
+
+void tst_LargeClass::counts()
+{
+    const QMetaObject *mo = &LargeClass::staticMetaObject;
+    QCOMPARE(mo->methodCount() - mo->methodOffset(), 4000);
+    QCOMPARE(mo->propertyCount() - mo->propertyOffset(), 1000);
+}
+
+void tst_LargeClass::methods()
+{
+    LargeClass obj;
+    const QMetaObject *mo = obj.metaObject();
+    QVERIFY(mo->indexOfSignal("signal_n000(int)") >= 0);
+    QVERIFY(mo->indexOfSignal("signal_n999(int)") >= 0);
+    QVERIFY(mo->indexOfSlot("otherSlot_n500(QString)") >= 0);
+
+    QVERIFY(connect(&obj, SIGNAL(signal_n123(int)), &obj, SLOT(slot_n987(int))));
+    emit obj.signal_n123(42);
+    QCOMPARE(obj.last, 42);
+
+    int result = 0;
+    QVERIFY(QMetaObject::invokeMethod(&obj, "invokable_n777", Q_RETURN_ARG(int, result), Q_ARG(int, 41)));
+    QCOMPARE(result, 42);
+}
+
+void tst_LargeClass::properties()
+{
+    LargeClass obj;
+    QVERIFY(obj.setProperty("property_n999", 999));
+    QCOMPARE(obj.member_n999, 999);
+    QCOMPARE(obj.property("property_n999"), QVariant(999));
+    QCOMPARE(obj.property("property_n000"), QVariant(0));
+}
+
+void tst_LargeClass::notifySignals()
+{
+    const QMetaObject *mo = &NotifyClass::staticMetaObject;
+    QCOMPARE(mo->methodCount() - mo->methodOffset(), 800);
+    QCOMPARE(mo->propertyCount() - mo->propertyOffset(), 801);
+
+    QMetaProperty first = mo->property(mo->indexOfProperty("notified_n000"));
+    QVERIFY(first.hasNotifySignal());
+    QCOMPARE(first.notifySignal().methodSignature(), QByteArray("notified_n000Changed()"));
+    QMetaProperty last = mo->property(mo->indexOfProperty("notified_n799"));
+    QCOMPARE(last.notifySignal().methodSignature(), QByteArray("notified_n799Changed()"));
+    QMetaProperty inherited = mo->property(mo->indexOfProperty("inherited"));
+    QVERIFY(inherited.hasNotifySignal());
+    QCOMPARE(inherited.notifySignal().methodSignature(), QByteArray("baseChanged()"));
+
+    NotifyClass obj;
+    QSignalSpy lastSpy(&obj, SIGNAL(notified_n799Changed()));
+    QVERIFY(obj.setProperty("notified_n799", 7));
+    QCOMPARE(obj.notifiedMember_n799, 7);
+    QCOMPARE(lastSpy.count(), 1);
+    QSignalSpy baseSpy(&obj, SIGNAL(baseChanged()));
+    QVERIFY(obj.setProperty("inherited", 3));
+    QCOMPARE(obj.inheritedMember, 3);
+    QCOMPARE(baseSpy.count(), 1);
+}
+
+QTEST_MAIN(tst_LargeClass)
+
+#include "tst_largeclass.moc"
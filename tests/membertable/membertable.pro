@@ -0,0 +1,9 @@
+CONFIG += testcase
+CONFIG += parallel_test
+TARGET = tst_membertable
+
+SOURCES += tst_membertable.cpp
+
+QT = testlib
+
+QMAKE_MOC_OPTIONS += --member-table
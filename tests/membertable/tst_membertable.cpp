@@ -0,0 +1,116 @@
+/****************************************************************************
+ *  Copyright (C) 2013-2016 Woboq GmbH
+ *  Olivier Goffart <contact at woboq.com>
+ *  https://woboq.com/
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <QtTest/QtTest>
+
+// Built with --member-table
+
+struct Point { int x; int y; };
+Q_DECLARE_METATYPE(Point)
+
+// Not standard layout: the properties still go through the switch
+class Object : public QObject
+{
+    Q_OBJECT
+    Q_PROPERTY(int number MEMBER m_number)
+    Q_PROPERTY(double real MEMBER m_real NOTIFY realChanged)
+    Q_PROPERTY(QString text MEMBER m_text)
+    Q_PROPERTY(Point point MEMBER m_point)
+    Q_PROPERTY(int constant MEMBER m_constant CONSTANT)
+    Q_PROPERTY(int withRead READ withRead MEMBER m_withRead)
+    Q_PROPERTY(bool flag MEMBER m_flag)
+public:
+    int m_number = 1;
+    double m_real = 2.5;
+    QString m_text = "three";
+    Point m_point = { 4, 5 };
+    int m_constant = 6;
+    int m_withRead = 7;
+    int withRead() const { return m_withRead * 10; }
+private:
+    bool m_flag : 1;
+public:
+    Object() : m_flag(true) {}
+    bool flag() const { return m_flag; }
+signals:
+    void realChanged();
+};
+
+// Standard layout: the properties go through the table
+struct Gadget {
+    Q_GADGET
+    Q_PROPERTY(int a MEMBER a)
+    Q_PROPERTY(qint64 b MEMBER b)
+public:
+    int a = 8;
+    qint64 b = 9;
+};
+
+class tst_MemberTable : public QObject
+{ Q_OBJECT
+private slots:
+    void object();
+    void gadget();
+};
+
+void tst_MemberTable::object()
+{
+    Object o;
+    QCOMPARE(o.property("number").toInt(), 1);
+    QCOMPARE(o.property("real").toDouble(), 2.5);
+    QCOMPARE(o.property("text").toString(), QString("three"));
+    QCOMPARE(o.property("point").value<Point>().y, 5);
+    QCOMPARE(o.property("constant").toInt(), 6);
+    QCOMPARE(o.property("withRead").toInt(), 70);
+    QCOMPARE(o.property("flag").toBool(), true);
+
+    QSignalSpy spy(&o, &Object::realChanged);
+    QVERIFY(o.setProperty("number", 11));
+    QVERIFY(o.setProperty("real", 12.5));
+    QVERIFY(o.setProperty("real", 12.5));
+    QVERIFY(o.setProperty("text", QString("thirteen")));
+    QVERIFY(o.setProperty("point", QVariant::fromValue(Point{ 14, 15 })));
+    QVERIFY(!o.setProperty("constant", 16));
+    QVERIFY(o.setProperty("flag", false));
+    QCOMPARE(o.m_number, 11);
+    QCOMPARE(o.m_real, 12.5);
+    QCOMPARE(spy.count(), 1);
+    QCOMPARE(o.m_text, QString("thirteen"));
+    QCOMPARE(o.m_point.x, 14);
+    QCOMPARE(o.m_constant, 6);
+    QCOMPARE(o.flag(), false);
+}
+
+void tst_MemberTable::gadget()
+{
+    Gadget g;
+    const QMetaObject &mo = Gadget::staticMetaObject;
+    QMetaProperty a = mo.property(mo.indexOfProperty("a"));
+    QMetaProperty b = mo.property(mo.indexOfProperty("b"));
+    QCOMPARE(a.readOnGadget(&g).toInt(), 8);
+    QCOMPARE(b.readOnGadget(&g).toLongLong(), Q_INT64_C(9));
+    QVERIFY(a.writeOnGadget(&g, 18));
+    QVERIFY(b.writeOnGadget(&g, Q_INT64_C(19)));
+    QCOMPARE(g.a, 18);
+    QCOMPARE(g.b, Q_INT64_C(19));
+}
+
+QTEST_MAIN(tst_MemberTable)
+
+#include "tst_membertable.moc"
@@ -0,0 +1,9 @@
+CONFIG += testcase
+CONFIG += parallel_test
+TARGET = tst_metacast
+
+SOURCES += tst_metacast.cpp
+
+QT = testlib
+
+QMAKE_MOC_OPTIONS += --metacast-hash
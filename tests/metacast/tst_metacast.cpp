@@ -0,0 +1,76 @@
+/****************************************************************************
+ *  Copyright (C) 2013-2016 Woboq GmbH
+ *  Olivier Goffart <contact at woboq.com>
+ *  https://woboq.com/
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <QtTest/QtTest>
+
+// Built with --metacast-hash
+
+struct Interface1 { virtual ~Interface1() {} virtual int one() = 0; };
+struct Interface2 { virtual ~Interface2() {} virtual int two() = 0; };
+Q_DECLARE_INTERFACE(Interface1, "com.woboq.mocng.Interface1")
+Q_DECLARE_INTERFACE(Interface2, "com.woboq.mocng.Interface2")
+
+struct OtherBase { virtual ~OtherBase() {} int other = 3; };
+
+class Base : public QObject, public Interface1
+{
+    Q_OBJECT
+    Q_INTERFACES(Interface1)
+public:
+    int one() override { return 1; }
+};
+
+class Derived : public Base, public OtherBase, public Interface2
+{
+    Q_OBJECT
+    Q_INTERFACES(Interface2)
+public:
+    int two() override { return 2; }
+};
+
+class tst_MetaCast : public QObject
+{ Q_OBJECT
+private slots:
+    void metacast();
+};
+
+void tst_MetaCast::metacast()
+{
+    Derived d;
+    QObject *o = &d;
+    QCOMPARE(qobject_cast<Derived*>(o), &d);
+    QCOMPARE(qobject_cast<Base*>(o), static_cast<Base*>(&d));
+    QCOMPARE(qobject_cast<tst_MetaCast*>(o), static_cast<tst_MetaCast*>(nullptr));
+    QCOMPARE(o->qt_metacast("QObject"), static_cast<void*>(o));
+    QCOMPARE(o->qt_metacast("NotAClass"), static_cast<void*>(nullptr));
+    QCOMPARE(static_cast<OtherBase*>(o->qt_metacast("OtherBase"))->other, 3);
+
+    QVERIFY(qobject_cast<Interface1*>(o));
+    QCOMPARE(qobject_cast<Interface1*>(o)->one(), 1);
+    QVERIFY(qobject_cast<Interface2*>(o));
+    QCOMPARE(qobject_cast<Interface2*>(o)->two(), 2);
+
+    Base b;
+    QVERIFY(!qobject_cast<Interface2*>(&b));
+    QVERIFY(!qobject_cast<Derived*>(&b));
+}
+
+QTEST_MAIN(tst_MetaCast)
+
+#include "tst_metacast.moc"
@@ -0,0 +1,9 @@
+CONFIG += testcase
+CONFIG += parallel_test
+TARGET = tst_metatypetable
+
+SOURCES += tst_metatypetable.cpp
+
+QT = testlib
+
+QMAKE_MOC_OPTIONS += --metatype-table
@@ -0,0 +1,109 @@
+/****************************************************************************
+ *  Copyright (C) 2013-2016 Woboq GmbH
+ *  Olivier Goffart <contact at woboq.com>
+ *  https://woboq.com/
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <QtTest/QtTest>
+
+// Built with --metatype-table
+
+struct CustomA { int a; };
+struct CustomB { int b; };
+// Only used by the private slots
+struct CustomC { int c; };
+struct CustomD { int d; };
+Q_DECLARE_METATYPE(CustomA)
+Q_DECLARE_METATYPE(CustomB)
+Q_DECLARE_METATYPE(CustomC)
+Q_DECLARE_METATYPE(CustomD)
+
+class ObjectPrivate;
+
+class Object : public QObject
+{
+    Q_OBJECT
+    ObjectPrivate *d = nullptr;
+    ObjectPrivate *d_func() { return d; }
+signals:
+    void signal1(int, CustomA, CustomB);
+    void signal2(CustomB, int = 0);
+public slots:
+    void slot1(const CustomA &, const CustomB &) {}
+public:
+    Q_INVOKABLE void method1(CustomB) {}
+private:
+    Q_PRIVATE_SLOT(d_func(), void privateSlot(CustomA, int))
+    Q_PRIVATE_SLOT(d_func(), void privateSlot2(int, CustomC))
+    Q_PRIVATE_SLOT(d_func(), void privateSlot3(const CustomD &))
+};
+
+class ObjectPrivate {
+public:
+    void privateSlot(CustomA, int) {}
+    void privateSlot2(int, CustomC) {}
+    void privateSlot3(const CustomD &) {}
+};
+
+class tst_MetaTypeTable : public QObject
+{ Q_OBJECT
+private slots:
+    void parameterType();
+};
+
+void tst_MetaTypeTable::parameterType()
+{
+    // QMetaMethod::parameterType uses RegisterMethodArgumentMetaType for the types which
+    // are not registered yet, so check these before registering them.
+    const QMetaObject &mo = Object::staticMetaObject;
+    QMetaMethod m = mo.method(mo.indexOfMethod("signal1(int,CustomA,CustomB)"));
+    QCOMPARE(m.parameterType(0), int(QMetaType::Int));
+    int IdA = m.parameterType(1);
+    QVERIFY(IdA != QMetaType::UnknownType);
+    QCOMPARE(IdA, qMetaTypeId<CustomA>());
+    int IdB = m.parameterType(2);
+    QCOMPARE(IdB, qMetaTypeId<CustomB>());
+
+    m = mo.method(mo.indexOfMethod("signal2(CustomB)"));
+    QCOMPARE(m.parameterType(0), IdB);
+    m = mo.method(mo.indexOfMethod("signal2(CustomB,int)"));
+    QCOMPARE(m.parameterType(0), IdB);
+    QCOMPARE(m.parameterType(1), int(QMetaType::Int));
+
+    m = mo.method(mo.indexOfMethod("slot1(CustomA,CustomB)"));
+    QCOMPARE(m.parameterType(0), IdA);
+    QCOMPARE(m.parameterType(1), IdB);
+
+    m = mo.method(mo.indexOfMethod("privateSlot(CustomA,int)"));
+    QCOMPARE(m.parameterType(0), IdA);
+    // The arguments after a builtin type, and the const references
+    m = mo.method(mo.indexOfMethod("privateSlot2(int,CustomC)"));
+    QCOMPARE(m.parameterType(0), int(QMetaType::Int));
+    int IdC = m.parameterType(1);
+    QVERIFY(IdC != QMetaType::UnknownType);
+    QCOMPARE(IdC, qMetaTypeId<CustomC>());
+    m = mo.method(mo.indexOfMethod("privateSlot3(CustomD)"));
+    int IdD = m.parameterType(0);
+    QVERIFY(IdD != QMetaType::UnknownType);
+    QCOMPARE(IdD, qMetaTypeId<CustomD>());
+
+    m = mo.method(mo.indexOfMethod("method1(CustomB)"));
+    QCOMPARE(m.parameterType(0), IdB);
+}
+
+QTEST_MAIN(tst_MetaTypeTable)
+
+#include "tst_metatypetable.moc"
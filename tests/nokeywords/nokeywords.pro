@@ -0,0 +1,7 @@
+CONFIG += testcase
+CONFIG += parallel_test
+TARGET = tst_nokeywords
+
+SOURCES += tst_nokeywords.cpp
+
+QT = testlib
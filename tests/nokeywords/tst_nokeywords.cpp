@@ -0,0 +1,65 @@
+/****************************************************************************
+ *  Copyright (C) 2013-2016 Woboq GmbH
+ *  Olivier Goffart <contact at woboq.com>
+ *  https://woboq.com/
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// The keywords are disabled while QtCore is included, and enabled again afterwards:
+// moc-ng injects the definitions of qobjectdefs.h again when QT_NO_KEYWORDS is undefined.
+#define QT_NO_KEYWORDS
+#include <QtTest/QtTest>
+#undef QT_NO_KEYWORDS
+
+#ifndef Q_MOC_RUN
+// qobjectdefs.h is not included again, so define them for the compiler
+#define signals Q_SIGNALS
+#define slots Q_SLOTS
+#define emit Q_EMIT
+#endif
+
+class NoKeywords : public QObject
+{
+    Q_OBJECT
+public:
+    int value = 0;
+signals:
+    void changed(int);
+public slots:
+    void update(int v) { value = v; }
+};
+
+class tst_NoKeywords : public QObject
+{ Q_OBJECT
+private Q_SLOTS:
+    void keywords();
+};
+
+void tst_NoKeywords::keywords()
+{
+    NoKeywords obj;
+    const QMetaObject *mo = obj.metaObject();
+    QCOMPARE(mo->methodCount() - mo->methodOffset(), 2);
+    QVERIFY(mo->indexOfSignal("changed(int)") >= 0);
+    QVERIFY(mo->indexOfSlot("update(int)") >= 0);
+
+    QVERIFY(connect(&obj, SIGNAL(changed(int)), &obj, SLOT(update(int))));
+    emit obj.changed(42);
+    QCOMPARE(obj.value, 42);
+}
+
+QTEST_MAIN(tst_NoKeywords)
+
+#include "tst_nokeywords.moc"
@@ -0,0 +1,9 @@
+CONFIG += testcase
+CONFIG += parallel_test
+TARGET = tst_sharedstrings
+
+SOURCES += tst_sharedstrings.cpp
+
+QT = testlib
+
+QMAKE_MOC_OPTIONS += --shared-strings --shared-extradata
@@ -0,0 +1,117 @@
+/****************************************************************************
+ *  Copyright (C) 2013-2016 Woboq GmbH
+ *  Olivier Goffart <contact at woboq.com>
+ *  https://woboq.com/
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <QtTest/QtTest>
+
+// Built with --shared-strings --shared-extradata
+
+class First : public QObject
+{
+    Q_OBJECT
+    Q_PROPERTY(QString value READ value)
+public:
+    QString value() const { return "first"; }
+signals:
+    void changed(const QString &value);
+};
+
+class Second : public First
+{
+    Q_OBJECT
+    Q_PROPERTY(QString value READ value)
+public:
+    enum Mode { Off, On };
+    Q_ENUM(Mode)
+    QString value() const { return "second"; }
+signals:
+    void changed(const QString &value, Mode mode);
+};
+
+struct Gadget
+{
+    Q_GADGET
+    Q_PROPERTY(int value MEMBER value)
+    Q_PROPERTY(Second::Mode mode MEMBER mode)
+public:
+    int value = 3;
+    Second::Mode mode = Second::On;
+};
+
+// Same related meta objects as Gadget
+struct OtherGadget
+{
+    Q_GADGET
+    Q_PROPERTY(Second::Mode mode MEMBER mode)
+public:
+    Second::Mode mode = Second::Off;
+};
+
+template<typename T>
+class Template : public QObject
+{
+    Q_OBJECT
+signals:
+    void changed(const QString &value);
+};
+
+class tst_SharedStrings : public QObject
+{ Q_OBJECT
+private slots:
+    void sharedStrings();
+};
+
+void tst_SharedStrings::sharedStrings()
+{
+    QCOMPARE(First::staticMetaObject.className(), "First");
+    QCOMPARE(Second::staticMetaObject.className(), "Second");
+    QCOMPARE(Gadget::staticMetaObject.className(), "Gadget");
+    QCOMPARE(Template<int>::staticMetaObject.className(), "Template");
+    QCOMPARE(staticMetaObject.className(), "tst_SharedStrings");
+
+    Second s;
+    QObject *o = &s;
+    QCOMPARE(qobject_cast<First*>(o), static_cast<First*>(&s));
+    QCOMPARE(qobject_cast<Second*>(o), &s);
+    QVERIFY(!qobject_cast<tst_SharedStrings*>(o));
+    QCOMPARE(o->property("value").toString(), QString("second"));
+
+    const QMetaObject *mo = &Second::staticMetaObject;
+    QMetaMethod m = mo->method(mo->indexOfSignal("changed(QString,Mode)"));
+    QVERIFY(m.isValid());
+    QCOMPARE(m.parameterNames().at(0), QByteArray("value"));
+    QCOMPARE(m.parameterNames().at(1), QByteArray("mode"));
+    QVERIFY(mo->indexOfSignal("changed(QString)") >= 0);
+    QCOMPARE(QMetaEnum::fromType<Second::Mode>().valueToKey(Second::On), "On");
+
+    Gadget g;
+    QCOMPARE(Gadget::staticMetaObject.property(0).readOnGadget(&g).toInt(), 3);
+
+    // The enumerators are found through the related meta objects
+    QMetaProperty p = Gadget::staticMetaObject.property(1);
+    QVERIFY(p.isEnumType());
+    QCOMPARE(p.enumerator().valueToKey(p.readOnGadget(&g).toInt()), "On");
+    OtherGadget og;
+    p = OtherGadget::staticMetaObject.property(0);
+    QVERIFY(p.isEnumType());
+    QCOMPARE(p.enumerator().valueToKey(p.readOnGadget(&og).toInt()), "Off");
+}
+
+QTEST_MAIN(tst_SharedStrings)
+
+#include "tst_sharedstrings.moc"
@@ -1,4 +1,4 @@
 TEMPLATE = subdirs
 
-SUBDIRS += templates autoreturn nested templates2
+SUBDIRS += templates autoreturn nested templates2 largeclass metacast metatypetable membertable sharedstrings constexprdata nokeywords widgetstags
 
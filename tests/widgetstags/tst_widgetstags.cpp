@@ -0,0 +1,54 @@
+/****************************************************************************
+ *  Copyright (C) 2013-2016 Woboq GmbH
+ *  Olivier Goffart <contact at woboq.com>
+ *  https://woboq.com/
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <QtTest/QtTest>
+#include <QtWidgets>
+
+// Tags are the macros defined within a Q_MOC_RUN block
+#ifndef Q_MOC_RUN
+#define MY_TAG
+#define OTHER_TAG
+#endif
+
+class TaggedWidget : public QWidget
+{
+    Q_OBJECT
+public slots:
+    MY_TAG void tagged() {}
+    OTHER_TAG void otherTagged() {}
+    void untagged() {}
+};
+
+class tst_WidgetsTags : public QObject
+{ Q_OBJECT
+private slots:
+    void tags();
+};
+
+void tst_WidgetsTags::tags()
+{
+    const QMetaObject *mo = &TaggedWidget::staticMetaObject;
+    QCOMPARE(mo->method(mo->indexOfSlot("tagged()")).tag(), "MY_TAG");
+    QCOMPARE(mo->method(mo->indexOfSlot("otherTagged()")).tag(), "OTHER_TAG");
+    QCOMPARE(mo->method(mo->indexOfSlot("untagged()")).tag(), "");
+}
+
+QTEST_MAIN(tst_WidgetsTags)
+
+#include "tst_widgetstags.moc"
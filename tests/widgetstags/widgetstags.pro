@@ -0,0 +1,7 @@
+CONFIG += testcase
+CONFIG += parallel_test
+TARGET = tst_widgetstags
+
+SOURCES += tst_widgetstags.cpp
+
+QT = testlib widgets